@@ -0,0 +1,75 @@
+#include "TDCpp_data.h"
+#include "TDCpp_binary.h"
+
+uint16_t binary_channel_bits(uint16_t max_channel) {
+    uint16_t bits = 1;
+    while (bits < 16 && (max_channel >> bits) != 0) bits++;
+    return bits;
+}
+
+uint64_t encode_events_block(const uint64_t *timestamp, const uint16_t *channel, uint64_t n_events,
+                             uint16_t channel_bits, uint8_t *destination) {
+    uint8_t *position = destination;
+    uint64_t previous_timestamp = n_events > 0 ? timestamp[0] : 0;
+
+    for (uint64_t i = 0; i < n_events; ++i) {
+        if (timestamp[i] < previous_timestamp) {
+            log_error_and_exit("The timestamps must be sorted to be saved in binary format.");
+        }
+        uint64_t delta = timestamp[i] - previous_timestamp;
+        if ((delta >> (64 - channel_bits)) != 0) {
+            log_error_and_exit("The time between two events is too long to be saved in binary format.");
+        }
+        previous_timestamp = timestamp[i];
+
+        // Seven bits per byte, the highest bit tells if another byte follows.
+        uint64_t value = (delta << channel_bits) | channel[i];
+        while (value >= 0x80) {
+            *position++ = (uint8_t) (value | 0x80);
+            value >>= 7;
+        }
+        *position++ = (uint8_t) value;
+    }
+
+    return (uint64_t) (position - destination);
+}
+
+bool decode_events_block(const uint8_t *block, uint64_t block_size, uint64_t n_events, uint64_t first_timestamp,
+                         uint16_t channel_bits, uint64_t *timestamp, uint16_t *channel) {
+    const uint8_t *position = block;
+    const uint8_t *end = block + block_size;
+    const uint64_t channel_mask = (1ULL << channel_bits) - 1;
+    uint64_t current_timestamp = first_timestamp;
+
+    for (uint64_t i = 0; i < n_events; ++i) {
+        // Most events fit in 4 bytes, so the common case has no loop.
+        uint64_t value;
+        if (end - position >= TDCPP_BINARY_MAX_EVENT_SIZE && position[0] < 0x80) {
+            value = position[0];
+            position += 1;
+        } else if (end - position >= TDCPP_BINARY_MAX_EVENT_SIZE && position[1] < 0x80) {
+            value = (uint64_t) (position[0] & 0x7F) | (uint64_t) position[1] << 7;
+            position += 2;
+        } else if (end - position >= TDCPP_BINARY_MAX_EVENT_SIZE && position[2] < 0x80) {
+            value = (uint64_t) (position[0] & 0x7F) | (uint64_t) (position[1] & 0x7F) << 7 |
+                    (uint64_t) position[2] << 14;
+            position += 3;
+        } else {
+            value = 0;
+            uint16_t shift = 0;
+            while (true) {
+                if (position == end || shift >= 64) return false;
+                uint8_t byte = *position++;
+                value |= (uint64_t) (byte & 0x7F) << shift;
+                if (byte < 0x80) break;
+                shift += 7;
+            }
+        }
+
+        current_timestamp += value >> channel_bits;
+        timestamp[i] = current_timestamp;
+        channel[i] = (uint16_t) (value & channel_mask);
+    }
+
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef TDCPP_BINARY_H
+#define TDCPP_BINARY_H
+
+#include <stdint-gcc.h>
+
+/**
+ * The binary event files start with these 8 bytes.
+ */
+#define TDCPP_BINARY_MAGIC "TDCPPEV1"
+#define TDCPP_BINARY_MAGIC_SIZE 8
+
+/**
+ * The number of events in each block of a binary event file. The last block can be shorter.
+ */
+#define TDCPP_BINARY_BLOCK_SIZE 65536
+
+/**
+ * The maximum number of bytes of an encoded event, i.e. of a 64bit varint.
+ */
+#define TDCPP_BINARY_MAX_EVENT_SIZE 10
+
+/**
+ * @brief The header of a binary event file.
+ *
+ * A binary event file is made of:
+ *  - this header,
+ *  - the blocks of events, each one starting with the first event of the block,
+ *  - the block index, num_blocks tdcpp_binary_block entries starting at index_offset.
+ *
+ * Each event is a single varint, the difference from the previous timestamp shifted left by channel_bits,
+ * or-ed with the stored channel. The first event of a block is relative to the first_timestamp of its block,
+ * so the blocks can be decoded on their own. All the integers are little endian.
+ */
+struct tdcpp_binary_header {
+    char magic[TDCPP_BINARY_MAGIC_SIZE];
+    uint64_t num_events;
+    uint64_t num_blocks;
+    uint64_t index_offset;
+    uint32_t block_size;
+    uint16_t channel_bits;
+    uint16_t num_channels;
+    uint16_t clock;
+    uint16_t box_number;
+    uint32_t reserved;
+};
+
+/**
+ * An entry of the block index of a binary event file.
+ */
+struct tdcpp_binary_block {
+    /** The position of the block in the file, in bytes. */
+    uint64_t offset;
+    /** The size of the block, in bytes. */
+    uint64_t size;
+    /** The timestamp of the first event of the block. */
+    uint64_t first_timestamp;
+};
+
+/**
+ * @param max_channel The largest stored channel.
+ * @return The number of bits needed to store the channels, at least one.
+ */
+uint16_t binary_channel_bits(uint16_t max_channel);
+
+/**
+ * Encode a block of sorted events.
+ * @param timestamp The timestamps of the events, sorted.
+ * @param channel The stored channels of the events, each one less than 2^channel_bits.
+ * @param n_events The number of events.
+ * @param channel_bits The number of bits of the channels.
+ * @param destination The encoded block. It must hold n_events * #TDCPP_BINARY_MAX_EVENT_SIZE bytes.
+ * @return The size of the encoded block, in bytes.
+ */
+uint64_t encode_events_block(const uint64_t *timestamp, const uint16_t *channel, uint64_t n_events,
+                             uint16_t channel_bits, uint8_t *destination);
+
+/**
+ * Decode a block of events, encoded by encode_events_block().
+ * @param block The encoded block.
+ * @param block_size The size of the encoded block, in bytes.
+ * @param n_events The number of events in the block.
+ * @param first_timestamp The timestamp of the first event of the block.
+ * @param channel_bits The number of bits of the channels.
+ * @param timestamp The destination timestamp array. Must be already allocated.
+ * @param channel The destination channel array. Must be already allocated.
+ * @return False if the block is shorter than n_events events.
+ */
+bool decode_events_block(const uint8_t *block, uint64_t block_size, uint64_t n_events, uint64_t first_timestamp,
+                         uint16_t channel_bits, uint64_t *timestamp, uint16_t *channel);
+
+#endif //TDCPP_BINARY_H
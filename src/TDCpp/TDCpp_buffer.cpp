@@ -0,0 +1,67 @@
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+#include "TDCpp_buffer.h"
+
+void *allocate_buffer_memory(uint64_t bytes, uint64_t *allocated_bytes) {
+    *allocated_bytes = 0;
+
+    if (bytes < TDCPP_BUFFER_HUGE_PAGE_SIZE) {
+        return malloc(bytes);
+    }
+
+    // Map one huge page more than needed, then cut the unaligned head and the tail.
+    const uint64_t rounded_bytes = (bytes + TDCPP_BUFFER_HUGE_PAGE_SIZE - 1) / TDCPP_BUFFER_HUGE_PAGE_SIZE
+                                   * TDCPP_BUFFER_HUGE_PAGE_SIZE;
+    const uint64_t mapped_bytes = rounded_bytes + TDCPP_BUFFER_HUGE_PAGE_SIZE;
+    void *mapped = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return malloc(bytes);
+    }
+
+    uintptr_t start = (uintptr_t) mapped;
+    uintptr_t aligned_start = (start + TDCPP_BUFFER_HUGE_PAGE_SIZE - 1) / TDCPP_BUFFER_HUGE_PAGE_SIZE
+                              * TDCPP_BUFFER_HUGE_PAGE_SIZE;
+    uint64_t head_bytes = aligned_start - start;
+    if (head_bytes > 0) munmap(mapped, head_bytes);
+    uint64_t tail_bytes = mapped_bytes - head_bytes - rounded_bytes;
+    if (tail_bytes > 0) munmap((void *) (aligned_start + rounded_bytes), tail_bytes);
+
+    // Transparent huge pages, they do not need to be reserved in advance. It is only a hint.
+    madvise((void *) aligned_start, rounded_bytes, MADV_HUGEPAGE);
+
+    *allocated_bytes = rounded_bytes;
+    return (void *) aligned_start;
+}
+
+void free_buffer_memory(void *memory, uint64_t allocated_bytes) {
+    if (allocated_bytes > 0) {
+        munmap(memory, allocated_bytes);
+    } else {
+        free(memory);
+    }
+}
+
+void first_touch_memory(void *memory, uint64_t bytes, uint16_t num_threads) {
+    if (num_threads == 0) num_threads = 1;
+
+    // Slices of whole huge pages, so that no page is touched by two threads.
+    uint64_t slice_bytes = (bytes / num_threads + TDCPP_BUFFER_HUGE_PAGE_SIZE - 1) / TDCPP_BUFFER_HUGE_PAGE_SIZE
+                           * TDCPP_BUFFER_HUGE_PAGE_SIZE;
+    if (slice_bytes == 0) slice_bytes = TDCPP_BUFFER_HUGE_PAGE_SIZE;
+
+    auto touch_slice = [&](uint64_t first) {
+        uint64_t length = bytes - first < slice_bytes ? bytes - first : slice_bytes;
+        memset((char *) memory + first, 0, length);
+    };
+
+    std::vector<std::thread> threads;
+    for (uint64_t first = slice_bytes; first < bytes; first += slice_bytes) {
+        threads.push_back(std::thread(touch_slice, first));
+    }
+    touch_slice(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
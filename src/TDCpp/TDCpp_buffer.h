@@ -0,0 +1,202 @@
+#ifndef TDCPP_BUFFER_H
+#define TDCPP_BUFFER_H
+
+#include <stdint-gcc.h>
+#include <cstring>
+#include <utility>
+
+/**
+ * The size of a huge page. Buffers at least this big are aligned to it and backed by transparent huge pages.
+ */
+#define TDCPP_BUFFER_HUGE_PAGE_SIZE 2097152
+
+/**
+ * Allocate the memory of a buffer. Big allocations are mapped, aligned to #TDCPP_BUFFER_HUGE_PAGE_SIZE and advised
+ * to use huge pages, the small ones use malloc().
+ * @param bytes The number of bytes needed.
+ * @param allocated_bytes Set to the number of bytes that were mapped, or to zero if malloc() was used.
+ * @return A pointer to the memory, or null if it could not be allocated.
+ */
+void *allocate_buffer_memory(uint64_t bytes, uint64_t *allocated_bytes);
+
+/**
+ * Free the memory of a buffer.
+ * @param memory The memory, from allocate_buffer_memory().
+ * @param allocated_bytes The number of bytes that were mapped, zero if malloc() was used.
+ */
+void free_buffer_memory(void *memory, uint64_t allocated_bytes);
+
+/**
+ * Write zeros to the memory, each thread to a contiguous slice of the same size. Linux places each page on the
+ * NUMA node of the thread that touches it first, so the slices end up next to the threads that later process
+ * them in the same way, as the parallel counting and merging do.
+ * @param memory The memory.
+ * @param bytes The size of the memory.
+ * @param num_threads The number of threads.
+ */
+void first_touch_memory(void *memory, uint64_t bytes, uint16_t num_threads);
+
+/**
+ * @brief This class owns an array of trivially copyable elements.
+ *
+ * The array is freed with the buffer and can only be moved, never copied. Arrays of #TDCPP_BUFFER_HUGE_PAGE_SIZE
+ * or more are backed by huge pages, to cut the TLB misses and page faults of the scans over the events.
+ * The elements are not initialized, unless allocate_zeroed() is used.
+ *
+ * Created on: Oct 16 2026
+ */
+template<typename T>
+class TDCpp_buffer {
+
+protected:
+    /**
+     * The array, or null.
+     */
+    T *elements;
+
+    /**
+     * The number of elements of #elements.
+     */
+    uint64_t size;
+
+    /**
+     * The number of bytes mapped for #elements, zero if it was allocated with malloc().
+     */
+    uint64_t allocated_bytes;
+
+public:
+    /**
+     * This is the default constructor, the buffer is empty.
+     */
+    TDCpp_buffer() : elements(nullptr), size(0), allocated_bytes(0) {
+    }
+
+    /**
+     * This is the default destructor. It frees the array.
+     */
+    ~TDCpp_buffer() {
+        this->reset();
+    }
+
+    /**
+     * This is the move constructor, the other buffer is left empty.
+     */
+    TDCpp_buffer(TDCpp_buffer &&other) : TDCpp_buffer() {
+        this->swap(other);
+    }
+
+    /**
+     * This is the move assignment, the other buffer is left empty.
+     */
+    TDCpp_buffer &operator=(TDCpp_buffer &&other) {
+        if (this != &other) {
+            this->reset();
+            this->swap(other);
+        }
+        return *this;
+    }
+
+    /**
+     * Replace the array with a new one, not initialized.
+     * @param new_size The number of elements. At least one element is allocated.
+     * @param num_threads If more than one, the pages are first touched by as many threads, see first_touch_memory().
+     * @return A pointer to the array, or null if it could not be allocated.
+     */
+    T *allocate(uint64_t new_size, uint16_t num_threads = 1) {
+        this->reset();
+
+        uint64_t bytes = (new_size > 0 ? new_size : 1) * sizeof(T);
+        this->elements = (T *) allocate_buffer_memory(bytes, &this->allocated_bytes);
+        if (this->elements == nullptr) return nullptr;
+
+        this->size = new_size;
+        if (num_threads > 1 && this->allocated_bytes > 0) first_touch_memory(this->elements, bytes, num_threads);
+
+        return this->elements;
+    }
+
+    /**
+     * Replace the array with a new one, set to zero.
+     * @param new_size The number of elements.
+     * @return A pointer to the array, or null if it could not be allocated.
+     */
+    T *allocate_zeroed(uint64_t new_size) {
+        if (this->allocate(new_size) == nullptr) return nullptr;
+
+        memset(this->elements, 0, (new_size > 0 ? new_size : 1) * sizeof(T));
+        return this->elements;
+    }
+
+    /**
+     * Grow or shrink the array, keeping the first elements.
+     * @param new_size The new number of elements.
+     * @return A pointer to the array, or null if it could not be allocated. The old array is kept in that case.
+     */
+    T *reallocate(uint64_t new_size) {
+        TDCpp_buffer new_buffer;
+        if (new_buffer.allocate(new_size) == nullptr) return nullptr;
+
+        uint64_t kept_size = new_size < this->size ? new_size : this->size;
+        if (kept_size > 0) memcpy(new_buffer.elements, this->elements, kept_size * sizeof(T));
+
+        this->swap(new_buffer);
+        return this->elements;
+    }
+
+    /**
+     * Free the array, the buffer is empty.
+     */
+    void reset() {
+        if (this->elements != nullptr) free_buffer_memory(this->elements, this->allocated_bytes);
+        this->elements = nullptr;
+        this->size = 0;
+        this->allocated_bytes = 0;
+    }
+
+    /**
+     * Exchange the arrays of two buffers.
+     */
+    void swap(TDCpp_buffer &other) {
+        std::swap(this->elements, other.elements);
+        std::swap(this->size, other.size);
+        std::swap(this->allocated_bytes, other.allocated_bytes);
+    }
+
+    /**
+     * @return A pointer to the array, or null if the buffer is empty.
+     */
+    T *data() const {
+        return elements;
+    }
+
+    /**
+     * @return The number of elements.
+     */
+    uint64_t get_size() const {
+        return size;
+    }
+
+    /**
+     * @return The number of bytes mapped for the array, zero if it is not backed by huge pages.
+     */
+    uint64_t get_allocated_bytes() const {
+        return allocated_bytes;
+    }
+
+    T &operator[](uint64_t index) const {
+        return elements[index];
+    }
+
+private:
+    /**
+     * Deleted copy constructor, the array has only one owner.
+     */
+    TDCpp_buffer(const TDCpp_buffer &) = delete;
+
+    /**
+     * Deleted assignment operator, the array has only one owner.
+     */
+    TDCpp_buffer &operator=(const TDCpp_buffer &) = delete;
+};
+
+#endif //TDCPP_BUFFER_H
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "TDCpp_cache.h"
+#include "TDCpp_metrics.h"
+
+TDCpp_cache::TDCpp_cache(const char *directory) {
+    this->directory = directory;
+    this->key = "TDCpp cache version " + std::to_string(TDCPP_CACHE_VERSION) + "\n";
+}
+
+void TDCpp_cache::add_file(const char *file_path) {
+    struct stat file_stat;
+    this->key += "file ";
+    this->key += file_path;
+    if (stat(file_path, &file_stat) == 0) {
+        this->key += " " + std::to_string((uint64_t) file_stat.st_dev) + " " + std::to_string((uint64_t) file_stat.st_ino)
+                     + " " + std::to_string((uint64_t) file_stat.st_size)
+                     + " " + std::to_string((uint64_t) file_stat.st_mtim.tv_sec)
+                     + "." + std::to_string((uint64_t) file_stat.st_mtim.tv_nsec);
+    } else {
+        this->key += " missing";
+    }
+    this->key += "\n";
+}
+
+void TDCpp_cache::add_file_content(const char *file_path) {
+    this->key += "content ";
+    this->key += file_path;
+    FILE *file = fopen(file_path, "r");
+    if (file) {
+        this->key += " ";
+        char buffer[4096];
+        size_t length;
+        while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            // Keep the key on one line per item.
+            for (size_t i = 0; i < length; ++i) {
+                this->key += buffer[i] == '\n' ? ' ' : buffer[i];
+            }
+        }
+        fclose(file);
+    } else {
+        this->key += " missing";
+    }
+    this->key += "\n";
+}
+
+void TDCpp_cache::add_box_file(const char *file_path, uint16_t box_number) {
+    this->add_file(file_path);
+    this->add_parameter("box", box_number);
+}
+
+void TDCpp_cache::add_parameter(const char *name, uint64_t value) {
+    this->key += "parameter ";
+    this->key += name;
+    this->key += " " + std::to_string(value) + "\n";
+}
+
+std::string TDCpp_cache::get_path() const {
+    // 64bit FNV-1a hash of the key. Collisions are ruled out by comparing the whole key when loading.
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : this->key) {
+        hash ^= (uint8_t) c;
+        hash *= 1099511628211ULL;
+    }
+
+    char name[32];
+    sprintf(name, "/%016" PRIx64 ".tdcpp", hash);
+    return this->directory + name;
+}
+
+bool TDCpp_cache::load(TDCpp_data *data, uint16_t num_threads) const {
+    TDCpp_stage_timer timer("cache_load");
+    const std::string path = this->get_path();
+
+    // The key file is written last, so if it matches the object is complete.
+    FILE *key_file = fopen((path + ".key").c_str(), "r");
+    if (!key_file) return false;
+
+    std::string saved_key;
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), key_file)) > 0) {
+        saved_key.append(buffer, length);
+    }
+    fclose(key_file);
+
+    if (saved_key != this->key || access(path.c_str(), R_OK) != 0) return false;
+
+    // A corrupted object, e.g. after a crash of the file system, is computed again as if it was missing.
+    if (!data->try_load_from_binary_file(path.c_str(), num_threads)) {
+        std::cerr << "Ignoring a corrupted object in the cache, " << path << std::endl;
+        return false;
+    }
+    timer.stop(data->get_size());
+    return true;
+}
+
+void TDCpp_cache::save(TDCpp_data *data) const {
+    const std::string path = this->get_path();
+    mkdir(this->directory.c_str(), 0755);
+
+    // Write everything under temporary names first, so that an interrupted run never leaves a valid key
+    // next to an incomplete object.
+    const std::string temporary_path = path + ".tmp";
+    FILE *test_file = fopen(temporary_path.c_str(), "wb");
+    if (!test_file) {
+        std::cerr << "Could not write to the cache, " << path << std::endl;
+        return;
+    }
+    fclose(test_file);
+
+    // An incomplete object or key is never renamed, so it can't be mistaken for a valid one.
+    if (!data->save_to_binary_file(temporary_path.c_str())) {
+        std::cerr << "Could not write to the cache, " << path << std::endl;
+        return;
+    }
+    if (rename(temporary_path.c_str(), path.c_str()) != 0) return;
+
+    const std::string temporary_key_path = path + ".key.tmp";
+    FILE *key_file = fopen(temporary_key_path.c_str(), "w");
+    if (!key_file) return;
+    bool is_written = fwrite(this->key.data(), 1, this->key.size(), key_file) == this->key.size();
+    if (fclose(key_file) != 0 || !is_written) {
+        remove(temporary_key_path.c_str());
+        std::cerr << "Could not write to the cache, " << path << std::endl;
+        return;
+    }
+    rename(temporary_key_path.c_str(), (path + ".key").c_str());
+}
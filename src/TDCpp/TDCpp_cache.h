@@ -0,0 +1,95 @@
+#ifndef TDCPP_CACHE_H
+#define TDCPP_CACHE_H
+
+#include <string>
+#include "TDCpp_data.h"
+
+/**
+ * The directory, relative to the working one, where the cached objects are saved.
+ */
+#define TDCPP_CACHE_DIRECTORY ".tdcpp_cache"
+
+/**
+ * The version of the cached data. It is part of every key, so it must be increased whenever the loading,
+ * the matching, the merging or the offsets change their results: the old cached objects are then ignored.
+ */
+#define TDCPP_CACHE_VERSION 1
+
+/**
+ * @brief This class keeps preprocessed TDCpp_data objects on disk, e.g. merged and offset-corrected, so that
+ * later runs on the same acquisition can skip straight to the analysis.
+ *
+ * Each object is identified by a key, made of everything it was computed from: the identity of the input files
+ * (path, device, inode, size and modification time), the content of small parameter files, such as the offsets,
+ * and any other parameter. The object is saved as a binary event file, named after a hash of the key, next to
+ * a file with the key itself, which is checked when loading.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_cache {
+protected:
+    /**
+     * The description of what the cached object is computed from, one item per line.
+     */
+    std::string key;
+
+    /**
+     * The directory where the cached objects are saved.
+     */
+    std::string directory;
+
+public:
+    /**
+     * This is the default constructor.
+     * @param directory The directory where the cached objects are saved. It is created when needed.
+     */
+    explicit TDCpp_cache(const char *directory = TDCPP_CACHE_DIRECTORY);
+
+    /**
+     * Add an input file to the key, by its identity. A file that does not exist is part of the key as well.
+     * @param file_path The path of the file.
+     */
+    void add_file(const char *file_path);
+
+    /**
+     * Add an input file to the key, by its identity, with the number of the box it is loaded as.
+     * @param file_path The path of the file.
+     * @param box_number The number of the box.
+     */
+    void add_box_file(const char *file_path, uint16_t box_number);
+
+    /**
+     * Add a small file to the key, by its content, e.g. an offset file that is rewritten with the same values.
+     * @param file_path The path of the file.
+     */
+    void add_file_content(const char *file_path);
+
+    /**
+     * Add a parameter to the key.
+     * @param name The name of the parameter.
+     * @param value The value of the parameter.
+     */
+    void add_parameter(const char *name, uint64_t value);
+
+    /**
+     * @return The path of the cached object, for the current key.
+     */
+    std::string get_path() const;
+
+    /**
+     * Load the cached object for the current key, if there is one. A successful load is timed as the stage
+     * cache_load of TDCpp_metrics.
+     * @param data An empty object, that is filled with the cached one.
+     * @param num_threads The number of threads used to load the object.
+     * @return True if the object was found and loaded, false if it must be computed.
+     */
+    bool load(TDCpp_data *data, uint16_t num_threads = 1) const;
+
+    /**
+     * Save an object for the current key. If the cache can't be written, the object is just not saved.
+     * @param data The object to save. Its events must be sorted.
+     */
+    void save(TDCpp_data *data) const;
+};
+
+#endif //TDCPP_CACHE_H
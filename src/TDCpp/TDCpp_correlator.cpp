@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <thread>
+#include "TDCpp_correlator.h"
+
+TDCpp_correlator::TDCpp_correlator(int64_t min_delay, int64_t max_delay, uint64_t bin_width) {
+    if (max_delay <= min_delay || bin_width == 0) {
+        log_error_and_exit("The correlation range is empty.");
+    }
+
+    this->min_delay = min_delay;
+    this->max_delay = max_delay;
+    this->bin_width = bin_width;
+    this->num_bins = ((uint64_t) (max_delay - min_delay) + bin_width - 1) / bin_width;
+    this->duration = 0;
+}
+
+TDCpp_correlator::~TDCpp_correlator() {
+}
+
+void TDCpp_correlator::add_pair(uint16_t start_channel, uint16_t stop_channel) {
+    for (auto const &pair : this->pairs) {
+        if (pair.first == start_channel && pair.second == stop_channel) {
+            log_error_and_exit("The same pair of channels can be correlated only once.");
+        }
+    }
+
+    this->pairs.push_back(std::make_pair(start_channel, stop_channel));
+}
+
+void TDCpp_correlator::compute(const TDCpp_data *data, uint16_t num_threads) {
+    const uint64_t num_pairs = this->pairs.size();
+    const uint64_t size = data->get_size();
+    const uint64_t *timestamp = data->get_timestamp_array();
+    const uint16_t *channel = data->get_channel_array();
+    const uint16_t num_channels = data->get_channels_number();
+
+    this->histogram.assign(num_pairs * this->num_bins, 0);
+    this->pair_singles.assign(num_pairs, std::make_pair(0, 0));
+    this->duration = 0;
+
+    if (size == 0 || num_pairs == 0) return;
+
+    // The difference between the channel numbers of the pairs and the ones stored in the array.
+    const uint16_t channel_base = (uint16_t) (data->get_channel(0) - channel[0]);
+
+    // Map each (start, stop) stored channel to its pair, so that all the pairs are computed at once.
+    std::vector<int32_t> pair_lookup((uint64_t) num_channels * num_channels, -1);
+    for (uint64_t p = 0; p < num_pairs; ++p) {
+        int32_t start_channel = (int32_t) this->pairs[p].first - channel_base;
+        int32_t stop_channel = (int32_t) this->pairs[p].second - channel_base;
+
+        if (start_channel < 0 || start_channel >= num_channels || stop_channel < 0 || stop_channel >= num_channels) {
+            log_error_and_exit("A channel to correlate is not in the data.");
+        }
+
+        pair_lookup[start_channel * num_channels + stop_channel] = (int32_t) p;
+    }
+
+    // Count the singles, for the normalization.
+    std::vector<uint64_t> singles(num_channels, 0);
+    for (uint64_t i = 0; i < size; ++i) {
+        singles[channel[i]]++;
+    }
+    for (uint64_t p = 0; p < num_pairs; ++p) {
+        this->pair_singles[p] = std::make_pair(singles[this->pairs[p].first - channel_base],
+                                               singles[this->pairs[p].second - channel_base]);
+    }
+    this->duration = timestamp[size - 1] - timestamp[0];
+
+    // Split the start events in slices of the same size, each with its own histogram.
+    if (num_threads == 0) num_threads = 1;
+    if (num_threads > size) num_threads = (uint16_t) size;
+
+    std::vector<std::vector<uint64_t> > slice_histogram(num_threads);
+    std::vector<std::thread> threads;
+
+    for (uint16_t s = 0; s < num_threads; ++s) {
+        slice_histogram[s].assign(num_pairs * this->num_bins, 0);
+
+        auto correlate = [this, timestamp, channel, size, &pair_lookup, num_channels, num_threads,
+                          &slice_histogram, s]() {
+            this->correlate_slice(timestamp, channel, size, pair_lookup.data(), num_channels,
+                                  size * s / num_threads, size * (s + 1) / num_threads, slice_histogram[s].data());
+        };
+
+        if (num_threads == 1) {
+            correlate();
+        } else {
+            threads.push_back(std::thread(correlate));
+        }
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // Reduce the histograms of the slices.
+    for (uint16_t s = 0; s < num_threads; ++s) {
+        for (uint64_t b = 0; b < num_pairs * this->num_bins; ++b) {
+            this->histogram[b] += slice_histogram[s][b];
+        }
+    }
+}
+
+void TDCpp_correlator::correlate_slice(const uint64_t *timestamp, const uint16_t *channel, uint64_t size,
+                                       const int32_t *pair_lookup, uint16_t num_channels,
+                                       uint64_t start_index, uint64_t end_index, uint64_t *slice_histogram) const {
+    if (start_index >= end_index) return;
+
+    // Which stored channels are the start of at least one pair.
+    std::vector<bool> is_start(num_channels, false);
+    for (uint16_t start_channel = 0; start_channel < num_channels; ++start_channel) {
+        for (uint16_t stop_channel = 0; stop_channel < num_channels; ++stop_channel) {
+            if (pair_lookup[start_channel * num_channels + stop_channel] >= 0) is_start[start_channel] = true;
+        }
+    }
+
+    // The first event that can be a stop for the first start event. The delay is a signed difference.
+    const uint64_t first_start = timestamp[start_index];
+    const int64_t min_delay = this->min_delay, max_delay = this->max_delay;
+    auto is_before_range = [first_start, min_delay](uint64_t value) {
+        return (int64_t) (value - first_start) < min_delay;
+    };
+    uint64_t low_index = (uint64_t) (std::partition_point(timestamp, timestamp + size, is_before_range) - timestamp);
+
+    for (uint64_t i = start_index; i < end_index; ++i) {
+        if (!is_start[channel[i]]) continue;
+
+        // Slide the pointer to the first possible stop event. It never goes back, since the array is sorted.
+        while (low_index < size && (int64_t) (timestamp[low_index] - timestamp[i]) < min_delay) {
+            low_index++;
+        }
+
+        const int32_t *start_lookup = pair_lookup + channel[i] * num_channels;
+        for (uint64_t j = low_index; j < size; ++j) {
+            int64_t delay = (int64_t) (timestamp[j] - timestamp[i]);
+            if (delay >= max_delay) break;
+
+            int32_t pair_index = start_lookup[channel[j]];
+            if (pair_index < 0 || j == i) continue;
+
+            slice_histogram[pair_index * this->num_bins + (uint64_t) (delay - min_delay) / this->bin_width]++;
+        }
+    }
+}
+
+double TDCpp_correlator::get_g2(uint64_t pair_index, uint64_t bin) const {
+    if (this->duration == 0) return 0;
+
+    double expected = (double) this->pair_singles[pair_index].first * this->pair_singles[pair_index].second *
+                      this->bin_width / this->duration;
+    if (expected == 0) return 0;
+
+    return this->get_count(pair_index, bin) / expected;
+}
+
+void TDCpp_correlator::save(const char *file_name, bool normalize) const {
+    FILE *output_file = fopen(file_name, "w");
+    if (output_file == NULL) {
+        std::string error_string("Can't write to  ");
+        error_string.append(file_name);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    for (uint64_t bin = 0; bin < this->num_bins; ++bin) {
+        fprintf(output_file, "%" PRId64, this->min_delay + (int64_t) (bin * this->bin_width));
+        for (uint64_t p = 0; p < this->pairs.size(); ++p) {
+            if (normalize) {
+                fprintf(output_file, "\t%.6f", this->get_g2(p, bin));
+            } else {
+                fprintf(output_file, "\t%" PRIu64, this->get_count(p, bin));
+            }
+        }
+        fprintf(output_file, "\n");
+    }
+
+    fclose(output_file);
+}
@@ -0,0 +1,137 @@
+#ifndef TDCPP_CORRELATOR_H
+#define TDCPP_CORRELATOR_H
+
+#include <vector>
+#include "TDCpp_data.h"
+
+/**
+ * @brief This class computes time-difference histograms (cross-correlations) between pairs of channels.
+ *
+ * For each pair (start, stop) it counts how many times an event on the stop channel follows an event on the
+ * start channel by a delay in [min_delay, max_delay), in bins of bin_width. Negative delays are allowed.
+ * All the pairs are computed at once with a sliding pointer over the sorted arrays of a TDCpp_data object,
+ * so the cost is proportional to the number of events times the number of events inside the delay range.
+ * The histograms can be normalized as a g(2) function, using the singles and the duration of the data.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_correlator {
+
+protected:
+    /**
+     * The minimum delay, in bins. It is the lower edge of the first histogram bin.
+     */
+    int64_t min_delay;
+
+    /**
+     * The maximum delay, in bins. It is excluded from the histogram.
+     */
+    int64_t max_delay;
+
+    /**
+     * The width of each histogram bin, in bins of the TDC.
+     */
+    uint64_t bin_width;
+
+    /**
+     * The number of histogram bins.
+     */
+    uint64_t num_bins;
+
+    /**
+     * The pairs of channels (start, stop), numbered as TDCpp_data::get_channel().
+     */
+    std::vector<std::pair<uint16_t, uint16_t> > pairs;
+
+    /**
+     * The histograms, one after the other in the order of #pairs. Each one is #num_bins long.
+     */
+    std::vector<uint64_t> histogram;
+
+    /**
+     * The singles of the start and stop channel of each pair, for the normalization.
+     */
+    std::vector<std::pair<uint64_t, uint64_t> > pair_singles;
+
+    /**
+     * The time between the first and the last event of the data, in bins, for the normalization.
+     */
+    uint64_t duration;
+
+public:
+    /**
+     * This is the default constructor.
+     * @param min_delay The minimum delay between the start and the stop event, in bins. Can be negative.
+     * @param max_delay The maximum delay between the start and the stop event, in bins. It is excluded.
+     * @param bin_width The width of each histogram bin, in bins.
+     */
+    TDCpp_correlator(int64_t min_delay, int64_t max_delay, uint64_t bin_width);
+
+    /**
+     * This is the default destructor.
+     */
+    virtual ~TDCpp_correlator();
+
+    /**
+     * Add a pair of channels to correlate. It must be called before compute().
+     * @param start_channel The channel of the start events, numbered as TDCpp_data::get_channel().
+     * @param stop_channel The channel of the stop events, numbered as TDCpp_data::get_channel().
+     *      It can be equal to start_channel for an auto-correlation, the event itself is never counted.
+     */
+    void add_pair(uint16_t start_channel, uint16_t stop_channel);
+
+    /**
+     * Compute the histograms of all the pairs, replacing the previous ones.
+     * @param data The events to correlate.
+     * @param num_threads The number of threads to use. The start events are split in time slices.
+     */
+    void compute(const TDCpp_data *data, uint16_t num_threads = 1);
+
+    /**
+     * @return The number of histogram bins.
+     */
+    uint64_t get_bins_number() const {
+        return num_bins;
+    }
+
+    /**
+     * @param pair_index The index of the pair, in the order they were added.
+     * @param bin The index of the histogram bin.
+     * @return The number of (start, stop) events in the bin.
+     */
+    uint64_t get_count(uint64_t pair_index, uint64_t bin) const {
+        return histogram[pair_index * num_bins + bin];
+    }
+
+    /**
+     * @param pair_index The index of the pair, in the order they were added.
+     * @param bin The index of the histogram bin.
+     * @return The count normalized by the one expected for uncorrelated events, i.e. g(2) of the bin.
+     */
+    double get_g2(uint64_t pair_index, uint64_t bin) const;
+
+    /**
+     * Save the histograms to file. Each line has the lower edge of the bin, in bins, and then a column per pair.
+     * @param file_name The name of the output file.
+     * @param normalize Save g(2) instead of the counts.
+     */
+    void save(const char *file_name, bool normalize = false) const;
+
+private:
+    /**
+     * Fill a histogram with the start events in [start_index, end_index). The stop events can be anywhere.
+     * @param timestamp A pointer to the timestamp array.
+     * @param channel A pointer to the channel array, from 0 to num_channels-1.
+     * @param size The size of the arrays.
+     * @param pair_lookup The index of the pair for each (start, stop) raw channel, or -1.
+     * @param num_channels The number of channels.
+     * @param start_index The first start event.
+     * @param end_index The index past the last start event.
+     * @param slice_histogram The histogram to fill, #num_bins for each pair.
+     */
+    void correlate_slice(const uint64_t *timestamp, const uint16_t *channel, uint64_t size,
+                         const int32_t *pair_lookup, uint16_t num_channels,
+                         uint64_t start_index, uint64_t end_index, uint64_t *slice_histogram) const;
+};
+
+#endif //TDCPP_CORRELATOR_H
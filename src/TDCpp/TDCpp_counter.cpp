@@ -0,0 +1,357 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <algorithm>
+#include <map>
+#include "TDCpp_counter.h"
+#include "TDCpp_utils.h"
+#include "TDCpp_events.h"
+
+TDCpp_coincidence_counter::TDCpp_coincidence_counter(uint16_t n, uint16_t num_channels, uint64_t coincidence_window,
+                                                     bool legacyFormat) {
+    this->n = n;
+    this->num_channels = num_channels;
+    this->coincidence_window = coincidence_window;
+    this->legacy_format = legacyFormat;
+
+    // Up to 64 channels the current window is a bitmask, otherwise a list of its channels.
+    this->is_wide = this->num_channels > 64;
+    if (this->is_wide) {
+        this->coincidence_channels.assign(this->n, 0);
+    }
+
+    // Allocate and set to zero the array for single events.
+    this->singles = (uint64_t *) calloc(this->num_channels, sizeof(uint64_t));
+
+    // Pascal's triangle, up to the needed size.
+    this->binomial = (uint64_t *) calloc((this->num_channels + 1) * (this->n + 1), sizeof(uint64_t));
+
+    if (this->singles == NULL || this->binomial == NULL) {
+        log_error_and_exit("Could not allocate the memory to count coincidences.");
+    }
+
+    for (uint16_t c = 0; c <= this->num_channels; ++c) {
+        this->binomial[c * (this->n + 1)] = 1;
+        for (uint16_t k = 1; k <= this->n && k <= c; ++k) {
+            this->binomial[c * (this->n + 1) + k] =
+                    this->binomial[(c - 1) * (this->n + 1) + k - 1] + this->binomial[(c - 1) * (this->n + 1) + k];
+        }
+    }
+    this->num_coincidences = this->binomial[this->num_channels * (this->n + 1) + this->n];
+
+    // Use the flat array if it is not too big, the maps otherwise.
+    this->coincidence_count = nullptr;
+    if (!this->is_wide && this->num_coincidences <= TDCPP_COUNTER_MAX_FLAT_SIZE) {
+        this->coincidence_count = (uint64_t *) calloc(this->num_coincidences + 1, sizeof(uint64_t));
+        if (this->coincidence_count == NULL) {
+            log_error_and_exit("Could not allocate the memory to count coincidences.");
+        }
+    }
+
+    this->coincidence_mask = 0;
+    this->coincidence_channel_index = 0;
+    this->coincidence_window_start = 0;
+    this->last_timestamp = 0;
+    this->is_coincidence_valid = true;
+    this->is_started = false;
+}
+
+TDCpp_coincidence_counter::~TDCpp_coincidence_counter() {
+    free(this->singles);
+    free(this->binomial);
+    free(this->coincidence_count);
+}
+
+void TDCpp_coincidence_counter::open_window(uint16_t channel) {
+    if (__builtin_expect(this->is_wide, 0)) {
+        this->coincidence_channels[0] = channel;
+    } else {
+        this->coincidence_mask = (uint64_t) 1 << channel;
+    }
+    this->coincidence_channel_index = 1;
+}
+
+bool TDCpp_coincidence_counter::add_to_window(uint16_t channel) {
+    if (__builtin_expect(this->is_wide, 0)) {
+        for (uint16_t j = 0; j < this->coincidence_channel_index; ++j) {
+            if (this->coincidence_channels[j] == channel) return false;
+        }
+        this->coincidence_channels[this->coincidence_channel_index] = channel;
+    } else {
+        uint64_t channel_bit = (uint64_t) 1 << channel;
+        if ((this->coincidence_mask & channel_bit) != 0) return false;
+        this->coincidence_mask |= channel_bit;
+    }
+    this->coincidence_channel_index++;
+    return true;
+}
+
+void TDCpp_coincidence_counter::push(uint64_t timestamp, uint16_t channel) {
+    // Increase the singles count
+    this->singles[channel] += 1;
+
+    // The very first event opens the first window.
+    if (__builtin_expect(!this->is_started, 0)) {
+        this->coincidence_window_start = timestamp;
+        this->open_window(channel);
+        this->last_timestamp = timestamp;
+        this->is_started = true;
+        return;
+    }
+
+    // If the event is in the coincidence window
+    if (timestamp - this->coincidence_window_start <= this->coincidence_window) {
+
+        // If there have not been already too much events in this window
+        if (this->coincidence_channel_index < this->n) {
+            // Add it to the coincidence, unless an event with the same channel has already been detected
+            if (!this->add_to_window(channel)) {
+                // Mark the coincidence as not valid
+                this->is_coincidence_valid = false;
+            }
+        } else {
+            // Mark the coincidence as not valid, too many events.
+            this->is_coincidence_valid = false;
+        }
+    } else {
+        bool is_new_window_valid;
+
+        // If this event is too close to the last one, which closed the coincidence
+        // window, mark the coincidence, as well as the next window, not valid.
+        if (timestamp - this->last_timestamp <= this->coincidence_window) {
+            this->is_coincidence_valid = false;
+            is_new_window_valid = false;
+        } else {
+            is_new_window_valid = true;
+        }
+
+        this->count_window();
+
+        // Start the new window
+        this->coincidence_window_start = timestamp;
+        this->open_window(channel);
+
+        // Start the new window as already invalid, if that's the case
+        this->is_coincidence_valid = is_new_window_valid;
+    }
+
+    this->last_timestamp = timestamp;
+}
+
+void TDCpp_coincidence_counter::process(const uint64_t *timestamp, const uint16_t *channel, uint64_t n_events) {
+    for (uint64_t i = 0; i < n_events; ++i) {
+        this->push(timestamp[i], channel[i]);
+    }
+}
+
+template<class Events>
+void TDCpp_coincidence_counter::process(const std::vector<TDCpp_coincidence_counter *> &counters,
+                                        const Events &events, uint64_t begin, uint64_t end) {
+    const uint64_t num_counters = counters.size();
+
+    // Every event is read once and fed to all the counters.
+    for (uint64_t i = begin; i < end; ++i) {
+        const uint64_t event_timestamp = events.get_timestamp(i);
+        const uint16_t event_channel = events.get_channel(i);
+        for (uint64_t k = 0; k < num_counters; ++k) {
+            counters[k]->push(event_timestamp, event_channel);
+        }
+    }
+}
+
+void TDCpp_coincidence_counter::count_window() {
+    if (!this->is_coincidence_valid || this->coincidence_channel_index != this->n) return;
+
+    if (this->coincidence_count) {
+        this->coincidence_count[this->coincidence_rank(this->coincidence_mask)] += 1;
+    } else if (!this->is_wide) {
+        this->coincidence_count_map[this->coincidence_mask] += 1;
+    } else {
+        // The channels are kept in the order they came, the key needs them sorted.
+        std::vector<uint16_t> key(this->coincidence_channels);
+        std::sort(key.begin(), key.end());
+        this->wide_coincidence_count_map[key] += 1;
+    }
+}
+
+void TDCpp_coincidence_counter::close_window() {
+    if (!this->is_started) return;
+
+    this->count_window();
+
+    // The next event will open a new window.
+    this->is_coincidence_valid = true;
+    this->is_started = false;
+}
+
+void TDCpp_coincidence_counter::add(const TDCpp_coincidence_counter &other) {
+    if (other.n != this->n || other.num_channels != this->num_channels) {
+        log_error_and_exit("Can't add the counts of coincidence counters with different parameters.");
+    }
+
+    for (uint16_t c = 0; c < this->num_channels; ++c) {
+        this->singles[c] += other.singles[c];
+    }
+
+    if (this->coincidence_count) {
+        for (uint64_t rank = 0; rank < this->num_coincidences; ++rank) {
+            this->coincidence_count[rank] += other.coincidence_count[rank];
+        }
+    } else {
+        for (auto const &count_entry : other.coincidence_count_map) {
+            this->coincidence_count_map[count_entry.first] += count_entry.second;
+        }
+        for (auto const &count_entry : other.wide_coincidence_count_map) {
+            this->wide_coincidence_count_map[count_entry.first] += count_entry.second;
+        }
+    }
+}
+
+template<class Events>
+std::vector<uint64_t> TDCpp_coincidence_counter::split_at_gaps(const Events &events, uint64_t size,
+                                                               uint64_t coincidence_window, uint16_t num_slices) {
+    std::vector<uint64_t> slice_start(1, 0);
+
+    for (uint16_t s = 1; s < num_slices; ++s) {
+        uint64_t index = size * s / num_slices;
+        if (index <= slice_start.back()) index = slice_start.back() + 1;
+
+        // Move forward until the event is far enough from the previous one.
+        while (index < size && events.get_timestamp(index) - events.get_timestamp(index - 1) <= coincidence_window) {
+            index++;
+        }
+
+        if (index >= size) break;
+        slice_start.push_back(index);
+    }
+
+    slice_start.push_back(size);
+    return slice_start;
+}
+
+// The accessors of TDCpp_data and TDCpp_packed, see count_event_coincidences().
+template void TDCpp_coincidence_counter::process<tdcpp_event_arrays>(
+        const std::vector<TDCpp_coincidence_counter *> &, const tdcpp_event_arrays &, uint64_t, uint64_t);
+template void TDCpp_coincidence_counter::process<tdcpp_packed_events>(
+        const std::vector<TDCpp_coincidence_counter *> &, const tdcpp_packed_events &, uint64_t, uint64_t);
+template std::vector<uint64_t> TDCpp_coincidence_counter::split_at_gaps<tdcpp_event_arrays>(
+        const tdcpp_event_arrays &, uint64_t, uint64_t, uint16_t);
+template std::vector<uint64_t> TDCpp_coincidence_counter::split_at_gaps<tdcpp_packed_events>(
+        const tdcpp_packed_events &, uint64_t, uint64_t, uint16_t);
+
+uint64_t TDCpp_coincidence_counter::coincidence_rank(uint64_t mask) const {
+    // The k-th channel of the set (in increasing order) contributes C(channel, k+1).
+    uint64_t rank = 0;
+    for (uint16_t k = 1; mask != 0; ++k) {
+        uint16_t c = (uint16_t) __builtin_ctzll(mask);
+        rank += this->binomial[c * (this->n + 1) + k];
+        mask &= mask - 1;
+    }
+
+    return rank;
+}
+
+uint64_t TDCpp_coincidence_counter::coincidence_unrank(uint64_t rank) const {
+    // Greedily find the biggest channel of the remaining set.
+    uint64_t mask = 0;
+    uint16_t c = this->num_channels;
+    for (uint16_t k = this->n; k >= 1; --k) {
+        do {
+            c--;
+        } while (this->binomial[c * (this->n + 1) + k] > rank);
+
+        mask |= (uint64_t) 1 << c;
+        rank -= this->binomial[c * (this->n + 1) + k];
+    }
+
+    return mask;
+}
+
+std::string TDCpp_coincidence_counter::coincidence_key(uint64_t mask) const {
+    std::vector<uint16_t> channels;
+    while (mask != 0) {
+        channels.push_back((uint16_t) __builtin_ctzll(mask));
+        mask &= mask - 1;
+    }
+
+    return this->coincidence_key(channels);
+}
+
+std::string TDCpp_coincidence_counter::coincidence_key(const std::vector<uint16_t> &channels) const {
+    std::string key;
+
+    // The channels are printed in increasing order, starting from 1.
+    for (uint16_t channel : channels) {
+        uint16_t channel_number = (uint16_t) (channel + 1);
+
+        if (!this->legacy_format) {
+            if (channel_number < 10) {
+                key.append("0");
+            }
+            key.append(std::to_string(channel_number));
+            key.append("_");
+        } else {
+            key.append(std::to_string(channel_number));
+            key.append(" ");
+        }
+    }
+
+    if (!this->legacy_format) {
+        key.pop_back();
+    } else {
+        key.append("%");
+    }
+
+    return key;
+}
+
+void TDCpp_coincidence_counter::save(const char *singles_file_name, const char *coincidences_file_name) const {
+    // Save the singles
+    FILE *singles_file = fopen(singles_file_name, "w");
+    if (singles_file == NULL) {
+        std::string error_string("Can't write to  ");
+        error_string.append(singles_file_name);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    for (uint64_t channel_index = 0; channel_index < this->num_channels; ++channel_index) {
+        if (this->singles[channel_index] != 0) {
+            fprintf(singles_file, "%" PRIu64 "\t%" PRIu64 "\n", channel_index + 1, this->singles[channel_index]);
+        }
+    }
+    fclose(singles_file);
+
+    // Save the coincidences
+    FILE *coincidences_file = fopen(coincidences_file_name, "w");
+    if (coincidences_file == NULL) {
+        std::string error_string("Can't write to  ");
+        error_string.append(coincidences_file_name);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    // Build the text keys of the coincidences that happened, the map sorts them as strings.
+    std::map<std::string, uint64_t> coincidences_map;
+    if (this->coincidence_count) {
+        for (uint64_t rank = 0; rank < this->num_coincidences; ++rank) {
+            if (this->coincidence_count[rank] != 0) {
+                coincidences_map[this->coincidence_key(this->coincidence_unrank(rank))] = this->coincidence_count[rank];
+            }
+        }
+    } else {
+        for (auto const &count_entry : this->coincidence_count_map) {
+            coincidences_map[this->coincidence_key(count_entry.first)] = count_entry.second;
+        }
+        for (auto const &count_entry : this->wide_coincidence_count_map) {
+            coincidences_map[this->coincidence_key(count_entry.first)] = count_entry.second;
+        }
+    }
+
+    for (auto const &map_entry : coincidences_map) {
+        if (!this->legacy_format) {
+            fprintf(coincidences_file, "%s %" PRIu64 "\n", map_entry.first.c_str(), map_entry.second);
+        } else {
+            fprintf(coincidences_file, "%s\n", map_entry.first.c_str());
+        }
+    }
+    fclose(coincidences_file);
+}
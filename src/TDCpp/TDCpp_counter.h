@@ -0,0 +1,265 @@
+#ifndef TDCPP_COUNTER_H
+#define TDCPP_COUNTER_H
+
+#include <stdint-gcc.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The maximum number of possible coincidences that are counted in a flat array.
+ * 2^20 counters take 8MB, that is C(64, 4) or C(48, 5).
+ */
+#define TDCPP_COUNTER_MAX_FLAT_SIZE 1048576
+
+/**
+ * @brief This class counts single events and n-fold coincidences on a stream of events.
+ *
+ * Events are fed in blocks with process(), the state of the current coincidence window is kept between
+ * calls, so that a window that spans two blocks is counted exactly as if the events were in one array.
+ * The channels must be the ones stored inside TDCpp_data, i.e. from 0 to num_channels-1.
+ *
+ * A coincidence is identified by the set of its channels, kept as a bitmask. Its rank in the combinatorial
+ * number system is a perfect hash of the set, so the coincidences are counted in a flat array without any
+ * allocation. The text keys are built only when the counts are saved. With more than 64 channels, e.g. when
+ * more than 8 boxes are merged, the set does not fit a bitmask: the channels of the window are kept in a list
+ * and the coincidences are counted in a map, as before the bitmasks.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_coincidence_counter {
+
+protected:
+    /**
+     * The *exact* number of events that make a coincidence.
+     */
+    uint16_t n;
+
+    /**
+     * The number of channels, i.e. the size of #singles.
+     */
+    uint16_t num_channels;
+
+    /**
+     * The maximum time distance *in bins* in which two or more events are considered coincident.
+     */
+    uint64_t coincidence_window;
+
+    /**
+     * Use an alternative printing standard, for compatibility.
+     */
+    bool legacy_format;
+
+    /**
+     * The count of single events on each channel.
+     */
+    uint64_t *singles;
+
+    /**
+     * The channels inside the current coincidence window, one bit per channel.
+     */
+    uint64_t coincidence_mask;
+
+    /**
+     * True if there are more than 64 channels, so the channels inside the current coincidence window are kept in
+     * #coincidence_channels instead of #coincidence_mask.
+     */
+    bool is_wide;
+
+    /**
+     * The channels inside the current coincidence window, in the order they came. Only used if #is_wide.
+     */
+    std::vector<uint16_t> coincidence_channels;
+
+    /**
+     * The number of events inside the current coincidence window.
+     */
+    uint16_t coincidence_channel_index;
+
+    /**
+     * The timestamp of the event that opened the current coincidence window.
+     */
+    uint64_t coincidence_window_start;
+
+    /**
+     * The timestamp of the last processed event.
+     */
+    uint64_t last_timestamp;
+
+    /**
+     * False if the current coincidence window has already been discarded.
+     */
+    bool is_coincidence_valid;
+
+    /**
+     * False until the first event has been processed.
+     */
+    bool is_started;
+
+    /**
+     * The binomial coefficients C(c, k), for c from 0 to num_channels and k from 0 to n.
+     * Stored as binomial[c * (n + 1) + k].
+     */
+    uint64_t *binomial;
+
+    /**
+     * The number of possible coincidences, i.e. C(num_channels, n).
+     */
+    uint64_t num_coincidences;
+
+    /**
+     * The count of each possible coincidence, indexed by its rank (see coincidence_rank()).
+     * It is used when #num_coincidences is at most #TDCPP_COUNTER_MAX_FLAT_SIZE, otherwise it is null.
+     */
+    uint64_t *coincidence_count;
+
+    /**
+     * The count of each coincidence, indexed by its channel mask.
+     * It is used only when there are too many possible coincidences for #coincidence_count.
+     */
+    std::unordered_map<uint64_t, uint64_t> coincidence_count_map;
+
+    /**
+     * The count of each coincidence, indexed by its sorted channels. It is used only if #is_wide.
+     */
+    std::map<std::vector<uint16_t>, uint64_t> wide_coincidence_count_map;
+
+public:
+    /**
+     * This is the default constructor.
+     * @param n The *exact* number of events that must occur at the same time (modulo coincidence_window).
+     *      If more, or less, than n events occur in the coincidence_window, the coincidence will be ignored.
+     * @param num_channels The number of channels of the data.
+     * @param coincidence_window The maximum time distance *in bins* in which two
+     *      or more events are considered coincident.
+     * @param legacyFormat Use and alternative printing standard, for compatibility.
+     */
+    TDCpp_coincidence_counter(uint16_t n, uint16_t num_channels, uint64_t coincidence_window,
+                              bool legacyFormat = false);
+
+    /**
+     * This is the default destructor.
+     */
+    virtual ~TDCpp_coincidence_counter();
+
+    /**
+     * Process a block of events. The events must come after the ones of the previous calls.
+     * @param timestamp A pointer to the timestamps of the events.
+     * @param channel A pointer to the channels of the events.
+     * @param n_events The number of events in the block.
+     */
+    void process(const uint64_t *timestamp, const uint16_t *channel, uint64_t n_events);
+
+    /**
+     * Process a range of events with many counters at once, e.g. with different coincidence windows.
+     * The events are read from memory only once.
+     * @param counters The counters.
+     * @param events The events, through an accessor, see tdcpp_event_arrays.
+     * @param begin The index of the first event of the range.
+     * @param end The index after the last event of the range.
+     */
+    template<class Events>
+    static void process(const std::vector<TDCpp_coincidence_counter *> &counters, const Events &events,
+                        uint64_t begin, uint64_t end);
+
+    /**
+     * Count the window that is still open as if it was closed by an event far away in time.
+     * It is used at the end of a time slice that is followed by a gap bigger than the coincidence window.
+     */
+    void close_window();
+
+    /**
+     * Add the counts of another counter to this one. The two counters must have the same parameters.
+     * @param other The counter whose counts are added.
+     */
+    void add(const TDCpp_coincidence_counter &other);
+
+    /**
+     * @brief Split the events in time slices that can be counted independently.
+     *
+     * Each slice starts with an event that is more than coincidence_window after the previous one.
+     * Such an event always closes the previous window and opens a valid one, so no window straddles two
+     * slices and counting the slices separately, with close_window() at the end of each one except the last,
+     * gives exactly the same counts as counting the whole array.
+     * @param events The events, through an accessor, see tdcpp_event_arrays.
+     * @param size The number of events.
+     * @param coincidence_window The coincidence window, in bins.
+     * @param num_slices The wanted number of slices, of roughly the same size.
+     * @return The index of the first event of each slice, followed by size. There can be less slices than
+     *      wanted if there are not enough gaps.
+     */
+    template<class Events>
+    static std::vector<uint64_t> split_at_gaps(const Events &events, uint64_t size, uint64_t coincidence_window,
+                                               uint16_t num_slices);
+
+    /**
+     * Save the counts to file.
+     * The coincidence window that is still open is not counted, since it could still be invalidated.
+     * @param singles_file_name The name of the file in which the single events count will be saved.
+     * @param coincidences_file_name The name of the file in which the coincidence events will be saved.
+     */
+    void save(const char *singles_file_name, const char *coincidences_file_name) const;
+
+private:
+    /**
+     * Process one event.
+     * @param timestamp The timestamp of the event.
+     * @param channel The channel of the event.
+     */
+    void push(uint64_t timestamp, uint16_t channel);
+
+    /**
+     * Make a channel the only one of the current coincidence window.
+     * @param channel The channel of the event that opens the window.
+     */
+    void open_window(uint16_t channel);
+
+    /**
+     * Add a channel to the current coincidence window.
+     * @param channel The channel of the event.
+     * @return False if the window already has an event on the same channel.
+     */
+    bool add_to_window(uint16_t channel);
+
+    /**
+     * Count the current coincidence window, if it is valid and has exactly n events.
+     */
+    void count_window();
+
+    /**
+     * @param mask A set of exactly n channels.
+     * @return The position of the set in the combinatorial number system, from 0 to #num_coincidences-1.
+     */
+    uint64_t coincidence_rank(uint64_t mask) const;
+
+    /**
+     * @param rank The position of a set of n channels in the combinatorial number system.
+     * @return The set of channels, as a bitmask.
+     */
+    uint64_t coincidence_unrank(uint64_t rank) const;
+
+    /**
+     * @param mask A set of channels.
+     * @return The key that is printed for the coincidence, in the current format.
+     */
+    std::string coincidence_key(uint64_t mask) const;
+
+    /**
+     * @param channels A set of channels, sorted.
+     * @return The key that is printed for the coincidence, in the current format.
+     */
+    std::string coincidence_key(const std::vector<uint16_t> &channels) const;
+
+    /**
+     * Deleted copy constructor.
+     */
+    TDCpp_coincidence_counter(const TDCpp_coincidence_counter &) = delete;
+
+    /**
+     * Deleted assignment operator.
+     */
+    TDCpp_coincidence_counter &operator=(const TDCpp_coincidence_counter &) = delete;
+};
+
+#endif //TDCPP_COUNTER_H
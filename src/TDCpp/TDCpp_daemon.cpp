@@ -0,0 +1,418 @@
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "TDCpp_daemon.h"
+#include "TDCpp_merger.h"
+#include "TDCpp_view.h"
+#include "TDCpp_correlator.h"
+#include "TDCpp_metrics.h"
+
+volatile sig_atomic_t TDCpp_daemon::stop_requested = 0;
+
+/**
+ * @return The number written in text, it is an error if it is not a whole number.
+ */
+static int64_t parse_number(const std::string &text) {
+    char *end = nullptr;
+    errno = 0;
+    long long value = strtoll(text.c_str(), &end, 10);
+
+    if (text.empty() || *end != '\0' || errno != 0) {
+        std::string error_string("Not a valid number, ");
+        error_string.append(text);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    return (int64_t) value;
+}
+
+/**
+ * @return The number written in text, it is an error if it is negative.
+ */
+static uint64_t parse_unsigned(const std::string &text) {
+    int64_t value = parse_number(text);
+
+    if (value < 0) {
+        std::string error_string("Not a valid positive number, ");
+        error_string.append(text);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    return (uint64_t) value;
+}
+
+/**
+ * Check the number of arguments of a command, the command included.
+ */
+static void check_arguments(const std::vector<std::string> &arguments, size_t min_size, size_t max_size) {
+    if (arguments.size() < min_size || arguments.size() > max_size) {
+        std::string error_string("Wrong number of arguments for ");
+        error_string.append(arguments[0]);
+        log_error_and_exit(error_string.c_str());
+    }
+}
+
+TDCpp_daemon::TDCpp_daemon(const char *socket_path, uint16_t num_threads) {
+    this->socket_path = socket_path;
+    this->listen_descriptor = -1;
+    this->num_threads = num_threads > 0 ? num_threads : 1;
+    this->is_running = true;
+}
+
+TDCpp_daemon::~TDCpp_daemon() {
+    if (this->listen_descriptor >= 0) {
+        close(this->listen_descriptor);
+        unlink(this->socket_path.c_str());
+    }
+
+    for (auto const &dataset : this->datasets) {
+        delete dataset.second;
+    }
+}
+
+void TDCpp_daemon::run() {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (this->socket_path.size() >= sizeof(address.sun_path)) {
+        log_error_and_exit("The socket path is too long.");
+    }
+    strcpy(address.sun_path, this->socket_path.c_str());
+
+    this->listen_descriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->listen_descriptor < 0) {
+        log_error_and_exit("Could not create the socket.");
+    }
+
+    // The socket of a previous daemon that did not exit cleanly would make bind() fail.
+    unlink(this->socket_path.c_str());
+
+    if (bind(this->listen_descriptor, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+        listen(this->listen_descriptor, 8) != 0) {
+        std::string error_string("Could not listen on ");
+        error_string.append(this->socket_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    std::cout << "Listening on " << this->socket_path << std::endl;
+
+    while (this->is_running && !stop_requested) {
+        int descriptor = accept(this->listen_descriptor, nullptr, nullptr);
+
+        if (descriptor < 0) {
+            // Interrupted by a signal, check if it asked to stop.
+            if (errno == EINTR) continue;
+            log_error_and_exit("Could not accept a connection.");
+        }
+
+        this->serve_connection(descriptor);
+        close(descriptor);
+    }
+}
+
+void TDCpp_daemon::serve_connection(int descriptor) {
+    std::string pending;
+    char buffer[4096];
+
+    while (true) {
+        ssize_t received = recv(descriptor, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return;
+
+        pending.append(buffer, (size_t) received);
+
+        // Answer every complete line, in order.
+        size_t line_end;
+        while ((line_end = pending.find('\n')) != std::string::npos) {
+            std::string response = this->handle_request(pending.substr(0, line_end));
+            response.push_back('\n');
+            pending.erase(0, line_end + 1);
+
+            // The client may have gone away, that must not kill the daemon.
+            if (send(descriptor, response.data(), response.size(), MSG_NOSIGNAL) != (ssize_t) response.size()) {
+                return;
+            }
+        }
+
+        if (pending.size() > TDCPP_DAEMON_MAX_REQUEST_SIZE) {
+            const std::string response("ERROR The request is too long\n");
+            send(descriptor, response.data(), response.size(), MSG_NOSIGNAL);
+            return;
+        }
+    }
+}
+
+std::string TDCpp_daemon::handle_request(const std::string &request) {
+    std::vector<std::string> arguments;
+    std::istringstream request_stream(request);
+    std::string argument;
+    while (request_stream >> argument) {
+        arguments.push_back(argument);
+    }
+
+    if (arguments.empty()) {
+        return "ERROR Empty request";
+    }
+
+    // Only the metrics of the previous request are kept.
+    if (arguments[0] != "metrics") {
+        TDCpp_metrics::reset();
+    }
+
+    try {
+        std::string result = this->execute(arguments);
+        return result.empty() ? "OK" : "OK " + result;
+    } catch (const TDCpp_error &error) {
+        return std::string("ERROR ") + error.what();
+    } catch (const std::bad_alloc &) {
+        return "ERROR Could not allocate the memory for the request.";
+    }
+}
+
+TDCpp_data *TDCpp_daemon::get_dataset(const std::string &name) {
+    auto dataset = this->datasets.find(name);
+
+    if (dataset == this->datasets.end()) {
+        std::string error_string("No dataset named ");
+        error_string.append(name);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    return dataset->second;
+}
+
+void TDCpp_daemon::check_unused(const std::string &name) {
+    for (auto const &dataset : this->sources) {
+        for (auto const &source : dataset.second) {
+            if (source == name) {
+                std::string error_string("The dataset ");
+                error_string.append(name + " is used by " + dataset.first);
+                log_error_and_exit(error_string.c_str());
+            }
+        }
+    }
+}
+
+void TDCpp_daemon::set_dataset(const std::string &name, TDCpp_data *data,
+                               const std::vector<std::string> &data_sources) {
+    auto dataset = this->datasets.find(name);
+
+    if (dataset != this->datasets.end()) {
+        try {
+            this->check_unused(name);
+            for (auto const &source : data_sources) {
+                if (source == name) {
+                    log_error_and_exit("A dataset can not replace one of its sources.");
+                }
+            }
+        } catch (...) {
+            delete data;
+            throw;
+        }
+        delete dataset->second;
+        dataset->second = data;
+    } else {
+        this->datasets[name] = data;
+    }
+
+    if (data_sources.empty()) {
+        this->sources.erase(name);
+    } else {
+        this->sources[name] = data_sources;
+    }
+}
+
+void TDCpp_daemon::drop_dataset(const std::string &name) {
+    auto dataset = this->datasets.find(name);
+
+    if (dataset != this->datasets.end()) {
+        delete dataset->second;
+        this->datasets.erase(dataset);
+        this->sources.erase(name);
+    }
+}
+
+std::string TDCpp_daemon::execute(const std::vector<std::string> &arguments) {
+    const std::string &command = arguments[0];
+
+    if (command == "load" || command == "load_binary") {
+        if (command == "load") {
+            check_arguments(arguments, 5, 5);
+        } else {
+            check_arguments(arguments, 3, 3);
+        }
+
+        TDCpp_data *data = new TDCpp_data();
+        try {
+            if (command == "load") {
+                data->load_from_mapped_file(arguments[2].c_str(), (uint16_t) parse_unsigned(arguments[3]),
+                                            (uint16_t) parse_unsigned(arguments[4]));
+            } else {
+                data->load_from_binary_file(arguments[2].c_str(), this->num_threads);
+            }
+        } catch (...) {
+            delete data;
+            throw;
+        }
+
+        this->set_dataset(arguments[1], data);
+        return std::to_string(data->get_size()) + " events";
+    }
+
+    if (command == "merge") {
+        check_arguments(arguments, 4, arguments.size());
+
+        std::vector<TDCpp_data *> sources;
+        for (size_t i = 2; i < arguments.size(); ++i) {
+            sources.push_back(this->get_dataset(arguments[i]));
+        }
+
+        // The merger points to its sources, they are kept until it is dropped.
+        TDCpp_data *merger = new TDCpp_merger(sources, this->num_threads);
+
+        this->set_dataset(arguments[1], merger,
+                          std::vector<std::string>(arguments.begin() + 2, arguments.end()));
+        return std::to_string(merger->get_size()) + " events";
+    }
+
+    if (command == "view") {
+        check_arguments(arguments, 5, 5);
+
+        TDCpp_data *view = new TDCpp_view(*this->get_dataset(arguments[2]), parse_unsigned(arguments[3]),
+                                          parse_unsigned(arguments[4]));
+        this->set_dataset(arguments[1], view, std::vector<std::string>(1, arguments[2]));
+        return std::to_string(view->get_size()) + " events";
+    }
+
+    if (command == "offset") {
+        check_arguments(arguments, 3, 3);
+
+        // A failed offset can leave the events half shifted, so the dataset is dropped.
+        TDCpp_data *data = this->get_dataset(arguments[1]);
+        this->check_unused(arguments[1]);
+        if (dynamic_cast<TDCpp_view *>(data) != nullptr) {
+            log_error_and_exit("A view can not be offset, it shares the events of its source.");
+        }
+        try {
+            data->set_channel_offset(arguments[2].c_str());
+        } catch (...) {
+            this->drop_dataset(arguments[1]);
+            throw;
+        }
+        return "";
+    }
+
+    if (command == "coincidences") {
+        check_arguments(arguments, 6, 7);
+
+        bool legacy_format = false;
+        if (arguments.size() == 7) {
+            if (arguments[6] != "legacy") {
+                log_error_and_exit("The only format option is legacy.");
+            }
+            legacy_format = true;
+        }
+
+        this->get_dataset(arguments[1])->find_n_fold_coincidences(
+                (uint16_t) parse_unsigned(arguments[2]), arguments[4].c_str(), arguments[5].c_str(),
+                parse_unsigned(arguments[3]), legacy_format, this->num_threads);
+        return "";
+    }
+
+    if (command == "sweep") {
+        check_arguments(arguments, 6, arguments.size());
+
+        std::vector<uint64_t> coincidence_windows;
+        for (size_t i = 5; i < arguments.size(); ++i) {
+            coincidence_windows.push_back(parse_unsigned(arguments[i]));
+        }
+
+        this->get_dataset(arguments[1])->sweep_n_fold_coincidences(
+                (uint16_t) parse_unsigned(arguments[2]), arguments[3].c_str(), arguments[4].c_str(),
+                coincidence_windows, false, this->num_threads);
+        return "";
+    }
+
+    if (command == "correlate") {
+        check_arguments(arguments, 7, arguments.size());
+
+        TDCpp_data *data = this->get_dataset(arguments[1]);
+        TDCpp_correlator correlator(parse_number(arguments[3]), parse_number(arguments[4]),
+                                    parse_unsigned(arguments[5]));
+
+        for (size_t i = 6; i < arguments.size(); ++i) {
+            size_t separator = arguments[i].find(':');
+            if (separator == std::string::npos) {
+                log_error_and_exit("The channel pairs must be written as START:STOP.");
+            }
+            correlator.add_pair((uint16_t) parse_unsigned(arguments[i].substr(0, separator)),
+                                (uint16_t) parse_unsigned(arguments[i].substr(separator + 1)));
+        }
+
+        correlator.compute(data, this->num_threads);
+        correlator.save(arguments[2].c_str());
+        return "";
+    }
+
+    if (command == "print") {
+        check_arguments(arguments, 3, 3);
+
+        this->get_dataset(arguments[1])->print_data_to_file(arguments[2].c_str(), this->num_threads);
+        return "";
+    }
+
+    if (command == "save") {
+        check_arguments(arguments, 3, 3);
+
+        if (!this->get_dataset(arguments[1])->save_to_binary_file(arguments[2].c_str())) {
+            std::string error_string("Could not write ");
+            error_string.append(arguments[2]);
+            log_error_and_exit(error_string.c_str());
+        }
+        return "";
+    }
+
+    if (command == "metrics") {
+        check_arguments(arguments, 2, 2);
+
+        TDCpp_metrics::save(arguments[1].c_str());
+        return "";
+    }
+
+    if (command == "list") {
+        check_arguments(arguments, 1, 1);
+
+        std::string result;
+        for (auto const &dataset : this->datasets) {
+            if (!result.empty()) result.push_back(' ');
+            result.append(dataset.first + ":" + std::to_string(dataset.second->get_size()));
+        }
+        return result;
+    }
+
+    if (command == "drop") {
+        check_arguments(arguments, 2, 2);
+
+        this->get_dataset(arguments[1]);
+        this->check_unused(arguments[1]);
+        this->drop_dataset(arguments[1]);
+        return "";
+    }
+
+    if (command == "shutdown") {
+        check_arguments(arguments, 1, 1);
+
+        this->is_running = false;
+        return "";
+    }
+
+    std::string error_string("Unknown command ");
+    error_string.append(command);
+    log_error_and_exit(error_string.c_str());
+    return "";
+}
@@ -0,0 +1,173 @@
+#ifndef TDCPP_DAEMON_H
+#define TDCPP_DAEMON_H
+
+#include <csignal>
+#include <map>
+#include <string>
+#include <vector>
+#include "TDCpp_data.h"
+
+/**
+ * The default path of the socket on which the daemon listens, relative to its working directory.
+ */
+#define TDCPP_DAEMON_SOCKET "tdcpp.sock"
+
+/**
+ * The maximum length of a request, in bytes. Longer requests are rejected and the connection is closed.
+ */
+#define TDCPP_DAEMON_MAX_REQUEST_SIZE 65536
+
+/**
+ * @brief This class is a resident analysis service, which keeps the loaded and merged datasets in memory.
+ *
+ * It listens on a local Unix socket. Each request is a line of words separated by spaces: a command, then its
+ * arguments. Each request gets a one line response, "OK" followed by an optional result, or "ERROR" followed by
+ * the message that log_error_and_exit() would have logged, so a failed request never stops the daemon.
+ * The requests are served one at a time, each one can use all the threads given to the constructor.
+ *
+ * The commands are:
+ *  - load NAME FILE CLOCK BOX: load a timestamp file from ID800-TDC as the dataset NAME.
+ *  - load_binary NAME FILE: load a binary event file as the dataset NAME.
+ *  - merge NAME SOURCE SOURCE...: merge two or more datasets, the first one is the reference for the time.
+ *  - view NAME SOURCE START END: the events of a dataset from START to END, in bins, without copying them.
+ *  - offset NAME FILE: set the channel offsets of a dataset, not of a view. If it fails, the dataset is dropped.
+ *  - coincidences NAME N WINDOW SINGLES_FILE COINCIDENCES_FILE [legacy]: count n-fold coincidences.
+ *  - sweep NAME N SINGLES_FILE COINCIDENCES_FILE WINDOW...: count n-fold coincidences for many windows.
+ *  - correlate NAME FILE MIN_DELAY MAX_DELAY BIN_WIDTH START:STOP...: compute cross-correlation histograms.
+ *  - print NAME FILE: print the events of a dataset as text.
+ *  - save NAME FILE: save a dataset as a binary event file.
+ *  - metrics FILE: save the metrics of the previous request, see TDCpp_metrics.
+ *  - list: the name and size of every dataset.
+ *  - drop NAME: free a dataset.
+ *  - shutdown: stop the daemon after the current connection.
+ *
+ * The paths are relative to the working directory of the daemon and can not contain spaces.
+ * A merged dataset or a view points to its sources, so they can not be dropped, replaced or offset while it exists.
+ * The metrics are reset by every request other than metrics, so they do not grow with the life of the daemon.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_daemon {
+
+protected:
+    /**
+     * The path of the listening socket.
+     */
+    std::string socket_path;
+
+    /**
+     * The listening socket, or -1 before run().
+     */
+    int listen_descriptor;
+
+    /**
+     * The number of threads used by each request.
+     */
+    uint16_t num_threads;
+
+    /**
+     * The datasets in memory, by name.
+     */
+    std::map<std::string, TDCpp_data *> datasets;
+
+    /**
+     * The names of the datasets that each dataset points to, by name. Only the merged datasets and the views have some.
+     */
+    std::map<std::string, std::vector<std::string>> sources;
+
+    /**
+     * False after a shutdown request.
+     */
+    bool is_running;
+
+    /**
+     * Set by request_stop(), to stop waiting for connections.
+     */
+    static volatile sig_atomic_t stop_requested;
+
+public:
+    /**
+     * This is the default constructor. It does not open the socket yet.
+     * @param socket_path The path of the socket on which the daemon listens.
+     * @param num_threads The number of threads used by each request.
+     */
+    explicit TDCpp_daemon(const char *socket_path = TDCPP_DAEMON_SOCKET, uint16_t num_threads = 1);
+
+    /**
+     * This is the default destructor. It removes the socket and frees all the datasets.
+     */
+    virtual ~TDCpp_daemon();
+
+    /**
+     * Listen on the socket and serve the connections, until a shutdown request or request_stop().
+     */
+    void run();
+
+    /**
+     * Execute a request.
+     * @param request A line with the command and its arguments.
+     * @return The response line, without the newline.
+     */
+    std::string handle_request(const std::string &request);
+
+    /**
+     * Stop the daemon when it is waiting for a connection. It can be called from a signal handler.
+     */
+    static void request_stop() {
+        stop_requested = 1;
+    }
+
+private:
+    /**
+     * Answer the requests on a connection until the client closes it.
+     * @param descriptor The connected socket.
+     */
+    void serve_connection(int descriptor);
+
+    /**
+     * Execute a command. The errors are raised with log_error_and_exit().
+     * @param arguments The command and its arguments.
+     * @return The result of the command, possibly empty.
+     */
+    std::string execute(const std::vector<std::string> &arguments);
+
+    /**
+     * @param name The name of a dataset.
+     * @return The dataset. It is an error if there is none with this name.
+     */
+    TDCpp_data *get_dataset(const std::string &name);
+
+    /**
+     * It is an error if another dataset points to this one.
+     * @param name The name of a dataset.
+     */
+    void check_unused(const std::string &name);
+
+    /**
+     * Store a dataset, freeing the one that had the same name. It is an error if another dataset points to that
+     * one, then data is freed instead.
+     * @param name The name of the dataset.
+     * @param data The dataset, now owned by the daemon.
+     * @param data_sources The names of the datasets that data points to.
+     */
+    void set_dataset(const std::string &name, TDCpp_data *data,
+                     const std::vector<std::string> &data_sources = std::vector<std::string>());
+
+    /**
+     * Free a dataset, if there is one with this name.
+     * @param name The name of the dataset.
+     */
+    void drop_dataset(const std::string &name);
+
+    /**
+     * Deleted copy constructor.
+     */
+    TDCpp_daemon(const TDCpp_daemon &) = delete;
+
+    /**
+     * Deleted assignment operator.
+     */
+    TDCpp_daemon &operator=(const TDCpp_daemon &) = delete;
+};
+
+#endif //TDCPP_DAEMON_H
@@ -1,16 +1,44 @@
 #include <iostream>
+#include <algorithm>
 #include <cstring>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "TDCpp_data.h"
+#include "TDCpp_mmap.h"
+#include "TDCpp_records.h"
+#include "TDCpp_events.h"
+#include "TDCpp_sort.h"
+#include "TDCpp_binary.h"
+#include "TDCpp_metrics.h"
 
 TDCpp_data::TDCpp_data() {
+    this->timestamp = nullptr;
+    this->channel = nullptr;
+    this->offset = nullptr;
+    this->size = 0;
+    this->has_time_index = false;
+    this->has_clock_index = false;
 }
 
 TDCpp_data::~TDCpp_data() {
-    free(this->timestamp);
-    free(this->channel);
+}
+
+void TDCpp_data::allocate_events(uint64_t n_events, uint16_t num_threads) {
+    this->timestamp = this->timestamp_buffer.allocate(n_events, num_threads);
+    this->channel = this->channel_buffer.allocate(n_events, num_threads);
+
+    if (this->timestamp == NULL || this->channel == NULL) {
+        log_error_and_exit("Could not allocate the memory for the events.");
+    }
 }
 
 void TDCpp_data::load_from_file(const char *data_file_path, uint16_t clock, uint16_t box_number) {
+    TDCpp_stage_timer timer("load");
+
     // Open the file
     FILE *data_file = fopen(data_file_path, "rb");
 
@@ -20,29 +48,23 @@ void TDCpp_data::load_from_file(const char *data_file_path, uint16_t clock, uint
 
         // And it is not empty
         if (this->size > 0) {
-            char *read_buffer = (char *) malloc(this->size * TDCPP_RECORD_SIZE);
-            this->timestamp = (uint64_t *) malloc(this->size * sizeof(uint64_t));
-            this->channel = (uint16_t *) malloc(this->size * sizeof(uint32_t));
-
-            if (read_buffer == NULL || this->timestamp == NULL || this->channel == NULL) {
+            TDCpp_buffer<char> read_buffer;
+            if (read_buffer.allocate(this->size * TDCPP_RECORD_SIZE) == NULL) {
                 log_error_and_exit("Could not allocate the memory to read a file.");
             }
+            this->allocate_events(this->size);
+
             // Seek until the end if the header
             fseek(data_file, TDCPP_HEADER_SIZE, SEEK_SET);
 
             // Read the whole file in the buffer. Faster than reading record by record.
-            fread(read_buffer, TDCPP_RECORD_SIZE, this->size, data_file);
+            fread(read_buffer.data(), TDCPP_RECORD_SIZE, this->size, data_file);
 
             // Close the file, it is not longer needed
             fclose(data_file);
 
             // Copy the data from the buffer to the arrays
-            for (int i = 0; i < this->size; i++) {
-                memcpy(this->timestamp + i, read_buffer + i * TDCPP_RECORD_SIZE, TDCPP_TIMESTAMP_SIZE);
-                memcpy(this->channel + i, read_buffer + i * TDCPP_RECORD_SIZE + TDCPP_TIMESTAMP_SIZE, TDCPP_CHANNEL_SIZE);
-            }
-
-            free(read_buffer);
+            deinterleave_records(read_buffer.data(), this->size, this->timestamp, this->channel);
         } else {
             // Close the file, it is not longer needed
             fclose(data_file);
@@ -55,12 +77,235 @@ void TDCpp_data::load_from_file(const char *data_file_path, uint16_t clock, uint
         log_error_and_exit(error_string.c_str());
     }
 
+    timer.stop(this->size, TDCPP_HEADER_SIZE + this->size * TDCPP_RECORD_SIZE);
 
     // Set the remaining members of the class.
+    this->init_box(clock, box_number);
+}
+
+void TDCpp_data::load_from_mapped_file(const char *data_file_path, uint16_t clock, uint16_t box_number) {
+    TDCpp_stage_timer timer("load");
+
+    // Map the file, the header is skipped by the mapping itself.
+    TDCpp_mapped_file data_file(data_file_path);
+
+    this->size = data_file.get_size();
+
+    // If the file is not empty
+    if (this->size > 0) {
+        this->allocate_events(this->size);
+
+        // Copy the records from the mapping to the arrays
+        deinterleave_records(data_file.get_records(), this->size, this->timestamp, this->channel);
+    }
+
+    timer.stop(this->size, TDCPP_HEADER_SIZE + this->size * TDCPP_RECORD_SIZE);
+
+    // Set the remaining members of the class.
+    this->init_box(clock, box_number);
+}
+
+void TDCpp_data::load_from_binary_file(const char *data_file_path, uint16_t num_threads) {
+    std::string error_string = this->read_binary_file(data_file_path, num_threads);
+    if (!error_string.empty()) {
+        log_error_and_exit(error_string.c_str());
+    }
+}
+
+bool TDCpp_data::try_load_from_binary_file(const char *data_file_path, uint16_t num_threads) {
+    return this->read_binary_file(data_file_path, num_threads).empty();
+}
+
+std::string TDCpp_data::read_binary_file(const char *data_file_path, uint16_t num_threads) {
+    TDCpp_stage_timer timer("load");
+
+    int data_file = open(data_file_path, O_RDONLY);
+    if (data_file < 0) {
+        return std::string("File not found, ") + data_file_path;
+    }
+
+    // Map the whole file, the blocks are decoded straight from the mapping.
+    struct stat file_stat;
+    if (fstat(data_file, &file_stat) != 0) {
+        close(data_file);
+        return std::string("Could not stat the file ") + data_file_path;
+    }
+    const uint64_t file_size = (uint64_t) file_stat.st_size;
+
+    void *mapped = file_size > 0 ? mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, data_file, 0) : MAP_FAILED;
+    close(data_file);
+    tdcpp_binary_header header;
+    if (mapped == MAP_FAILED || file_size < sizeof(header)) {
+        if (mapped != MAP_FAILED) munmap(mapped, file_size);
+        return "The binary event file is truncated.";
+    }
+    const uint8_t *file_buffer = (const uint8_t *) mapped;
+    // The threads read different parts of the file at the same time.
+    madvise(mapped, file_size, MADV_WILLNEED);
+
+    memcpy(&header, file_buffer, sizeof(header));
+    if (memcmp(header.magic, TDCPP_BINARY_MAGIC, TDCPP_BINARY_MAGIC_SIZE) != 0) {
+        munmap(mapped, file_size);
+        return std::string("Not a binary event file, ") + data_file_path;
+    }
+    if (header.index_offset > file_size ||
+        (file_size - header.index_offset) / sizeof(tdcpp_binary_block) < header.num_blocks ||
+        header.block_size == 0 || header.channel_bits == 0 || header.channel_bits > 16) {
+        munmap(mapped, file_size);
+        return "The binary event file is truncated.";
+    }
+    // Every event needs a block, and every stored channel must have its counters.
+    if (header.num_blocks != header.num_events / header.block_size + (header.num_events % header.block_size != 0) ||
+        header.num_channels == 0 || header.channel_bits > binary_channel_bits((uint16_t) (header.num_channels - 1))) {
+        munmap(mapped, file_size);
+        return "The binary event file is corrupted.";
+    }
+    // The index follows the blocks, so it is not aligned in the mapping.
+    std::vector<tdcpp_binary_block> blocks(header.num_blocks);
+    memcpy(blocks.data(), file_buffer + header.index_offset, header.num_blocks * sizeof(tdcpp_binary_block));
+
+    this->size = header.num_events;
+    // Each thread decodes a contiguous range of blocks, the same part of the arrays whose pages it first touches,
+    // so that they are placed next to it. The later stages split the events in contiguous parts as well.
+    if (num_threads == 0) num_threads = 1;
+    this->allocate_events(this->size, num_threads);
+
+    // The blocks are independent, each thread decodes a range of them.
+    std::vector<uint8_t> is_decoded(num_threads, 1);
+    auto decode_blocks = [&](uint16_t t) {
+        const uint64_t last_block = header.num_blocks * (t + 1) / num_threads;
+        for (uint64_t b = header.num_blocks * t / num_threads; b < last_block; ++b) {
+            uint64_t first_index = b * header.block_size;
+            if (first_index > this->size || blocks[b].offset > header.index_offset ||
+                blocks[b].size > header.index_offset - blocks[b].offset) {
+                is_decoded[t] = 0;
+                return;
+            }
+            uint64_t n_events = this->size - first_index < header.block_size ? this->size - first_index
+                                                                              : header.block_size;
+            if (!decode_events_block(file_buffer + blocks[b].offset, blocks[b].size, n_events,
+                                     blocks[b].first_timestamp, header.channel_bits,
+                                     this->timestamp + first_index, this->channel + first_index)) {
+                is_decoded[t] = 0;
+                return;
+            }
+
+            // The channel bits can hold channels that do not exist.
+            uint16_t max_channel = 0;
+            for (uint64_t i = first_index; i < first_index + n_events; ++i) {
+                if (this->channel[i] > max_channel) max_channel = this->channel[i];
+            }
+            if (max_channel >= header.num_channels) {
+                is_decoded[t] = 0;
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint16_t t = 1; t < num_threads; ++t) {
+        threads.push_back(std::thread(decode_blocks, t));
+    }
+    decode_blocks(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    munmap(mapped, file_size);
+
+    for (uint16_t t = 0; t < num_threads; ++t) {
+        if (!is_decoded[t]) {
+            // Whatever was decoded must not be mistaken for events.
+            this->size = 0;
+            return "The binary event file is corrupted.";
+        }
+    }
+
+    timer.stop(this->size, file_size);
+
+    this->has_time_index = false;
+    this->clock = header.clock;
+    this->box_number = header.box_number;
+    this->num_channels = header.num_channels;
+    this->offset = this->offset_buffer.allocate_zeroed(this->num_channels);
+    this->build_clock_index();
+    return "";
+}
+
+bool TDCpp_data::save_to_binary_file(const char *output_file_path) {
+    TDCpp_stage_timer timer("output");
+
+    FILE *output_file = fopen(output_file_path, "wb");
+    if (!output_file) {
+        std::string error_string("Can't write to  ");
+        error_string.append(output_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    uint16_t max_channel = 0;
+    for (uint64_t i = 0; i < this->size; ++i) {
+        if (this->channel[i] > max_channel) max_channel = this->channel[i];
+    }
+
+    tdcpp_binary_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TDCPP_BINARY_MAGIC, TDCPP_BINARY_MAGIC_SIZE);
+    header.num_events = this->size;
+    header.num_blocks = (this->size + TDCPP_BINARY_BLOCK_SIZE - 1) / TDCPP_BINARY_BLOCK_SIZE;
+    header.block_size = TDCPP_BINARY_BLOCK_SIZE;
+    header.channel_bits = binary_channel_bits(max_channel);
+    header.num_channels = this->num_channels;
+    header.clock = this->clock;
+    header.box_number = this->box_number;
+    // Every write is checked, so that a full disk does not leave a file that looks complete.
+    bool is_written = fwrite(&header, sizeof(header), 1, output_file) == 1;
+
+    // Encode and write one block at a time, keeping track of where each one is.
+    std::vector<tdcpp_binary_block> blocks(header.num_blocks);
+    uint8_t *block_buffer = (uint8_t *) malloc(TDCPP_BINARY_BLOCK_SIZE * TDCPP_BINARY_MAX_EVENT_SIZE);
+    if (block_buffer == NULL) {
+        log_error_and_exit("Could not allocate the memory to write a file.");
+    }
+
+    uint64_t file_position = sizeof(header);
+    for (uint64_t b = 0; b < header.num_blocks && is_written; ++b) {
+        uint64_t first_index = b * TDCPP_BINARY_BLOCK_SIZE;
+        uint64_t n_events = this->size - first_index < TDCPP_BINARY_BLOCK_SIZE ? this->size - first_index
+                                                                                : TDCPP_BINARY_BLOCK_SIZE;
+        blocks[b].offset = file_position;
+        blocks[b].first_timestamp = this->timestamp[first_index];
+        blocks[b].size = encode_events_block(this->timestamp + first_index, this->channel + first_index, n_events,
+                                             header.channel_bits, block_buffer);
+        is_written = fwrite(block_buffer, 1, blocks[b].size, output_file) == blocks[b].size;
+        file_position += blocks[b].size;
+    }
+    free(block_buffer);
+
+    // Write the index at the end, and its position in the header.
+    header.index_offset = file_position;
+    is_written = is_written &&
+                 fwrite(blocks.data(), sizeof(tdcpp_binary_block), header.num_blocks, output_file) == header.num_blocks &&
+                 fseek(output_file, 0, SEEK_SET) == 0 &&
+                 fwrite(&header, sizeof(header), 1, output_file) == 1;
+
+    // The buffered data is only written by fclose(), which can fail as well.
+    if (fclose(output_file) != 0) is_written = false;
+    if (!is_written) {
+        remove(output_file_path);
+        return false;
+    }
+
+    timer.stop(this->size, file_position + header.num_blocks * sizeof(tdcpp_binary_block));
+    return true;
+}
+
+void TDCpp_data::init_box(uint16_t clock, uint16_t box_number) {
+    this->has_time_index = false;
     this->clock = clock;
     this->box_number = box_number;
     this->num_channels = 8;
-    this->offset = (int16_t *) calloc(this->num_channels, sizeof(int16_t));
+    this->offset = this->offset_buffer.allocate_zeroed(this->num_channels);
+    this->build_clock_index();
 }
 
 uint64_t TDCpp_data::get_file_size(FILE *data_file) {
@@ -103,48 +348,100 @@ uint16_t TDCpp_data::get_channel(uint64_t index) const {
 }
 
 uint64_t TDCpp_data::find_one_second_index() {
-    uint64_t start_index = 0;
-    uint64_t end_index = this->size - 1;
-    uint64_t index;
-    // When start_index and end_index are just one position apart the search is completed.
-    while (end_index - start_index > 1) {
-        index = (end_index + start_index) / 2;
-        if (this->timestamp[index] > TDCPP_ONE_SEC_BINS + this->timestamp[0]) {
-            end_index = index;
-        } else if (this->timestamp[index] < TDCPP_ONE_SEC_BINS + this->timestamp[0]) {
-            start_index = index;
-        } else {
-            end_index = index;
-            start_index = index;
+    // The last event that is not after one second since the first one.
+    uint64_t index = this->find_time_index(this->timestamp[0] + TDCPP_ONE_SEC_BINS + 1);
+    return index > 0 ? index - 1 : 0;
+}
+
+void TDCpp_data::build_time_index() {
+    const uint64_t num_blocks = (this->size + TDCPP_TIME_INDEX_BLOCK_SIZE - 1) / TDCPP_TIME_INDEX_BLOCK_SIZE;
+    this->block_min_timestamp.assign(num_blocks, 0);
+    this->block_max_timestamp.assign(num_blocks, 0);
+
+    uint64_t max_timestamp = 0;
+    for (uint64_t b = 0; b < num_blocks; ++b) {
+        uint64_t start = b * TDCPP_TIME_INDEX_BLOCK_SIZE;
+        uint64_t end = this->size - start < TDCPP_TIME_INDEX_BLOCK_SIZE ? this->size
+                                                                        : start + TDCPP_TIME_INDEX_BLOCK_SIZE;
+        uint64_t min_timestamp = this->timestamp[start];
+        for (uint64_t i = start; i < end; ++i) {
+            if (this->timestamp[i] < min_timestamp) min_timestamp = this->timestamp[i];
+            if (this->timestamp[i] > max_timestamp) max_timestamp = this->timestamp[i];
         }
+        this->block_min_timestamp[b] = min_timestamp;
+        this->block_max_timestamp[b] = max_timestamp;
     }
-    // We arbitrarily choose to return the lesser of the two.
-    return start_index;
 
+    this->has_time_index = true;
 }
 
-uint64_t TDCpp_data::get_clock_array(uint64_t *destination_array) {
-    uint64_t index = 0;
-    for (int i = 0; i < this->size; ++i) {
-        // If this event is a clock, add it to destination_array
-        if (*(this->channel + i) + 1 == this->clock) {
-            *(destination_array + index) = *(this->timestamp + i);
-            index++;
+uint64_t TDCpp_data::find_time_index(uint64_t time) {
+    if (!this->has_time_index) this->build_time_index();
+
+    // The first block that reaches time, then the first event inside it.
+    const std::vector<uint64_t> &block_max = this->block_max_timestamp;
+    uint64_t b = (uint64_t) (std::lower_bound(block_max.begin(), block_max.end(), time) - block_max.begin());
+    if (b == block_max.size()) return this->size;
+
+    uint64_t start = b * TDCPP_TIME_INDEX_BLOCK_SIZE;
+    if (this->block_min_timestamp[b] >= time) return start;
+
+    uint64_t end = this->size - start < TDCPP_TIME_INDEX_BLOCK_SIZE ? this->size : start + TDCPP_TIME_INDEX_BLOCK_SIZE;
+    return (uint64_t) (std::lower_bound(this->timestamp + start, this->timestamp + end, time) - this->timestamp);
+}
+
+void TDCpp_data::build_clock_index() {
+    TDCpp_stage_timer timer("clock_index");
+
+    this->clock_position.clear();
+    this->clock_timestamp.clear();
+    for (uint64_t i = 0; i < this->size; ++i) {
+        if (this->channel[i] + 1 == this->clock) {
+            this->clock_position.push_back(i);
+            this->clock_timestamp.push_back(this->timestamp[i]);
         }
     }
+    this->clock_position.shrink_to_fit();
+    this->clock_timestamp.shrink_to_fit();
+    this->has_clock_index = true;
+
+    timer.stop(this->size);
+}
+
+uint64_t TDCpp_data::get_clock_array(uint64_t *destination_array) {
+    if (!this->has_clock_index) this->build_clock_index();
+    if (!this->clock_timestamp.empty()) {
+        memcpy(destination_array, this->clock_timestamp.data(), this->clock_timestamp.size() * sizeof(uint64_t));
+    }
 
     // Return the number of clock events found
-    return index;
+    return this->clock_timestamp.size();
 }
 
-uint64_t TDCpp_data::find_nth_clock(uint64_t n) {
-    uint64_t index = 0;
-    do {
-        if (*(this->channel + index) + 1 == this->clock) n--;
-        index++;
-    } while (n > 0);
+const uint64_t *TDCpp_data::get_clock_timestamps() {
+    if (!this->has_clock_index) this->build_clock_index();
+    return this->clock_timestamp.data();
+}
+
+uint64_t TDCpp_data::get_clock_number() {
+    if (!this->has_clock_index) this->build_clock_index();
+    return this->clock_position.size();
+}
 
-    return index - 1;
+uint64_t TDCpp_data::count_clocks(uint64_t start_index, uint64_t end_index) {
+    if (!this->has_clock_index) this->build_clock_index();
+    if (end_index <= start_index) return 0;
+    auto first = std::lower_bound(this->clock_position.begin(), this->clock_position.end(), start_index);
+    auto last = std::lower_bound(first, this->clock_position.end(), end_index);
+    return (uint64_t) (last - first);
+}
+
+uint64_t TDCpp_data::find_nth_clock(uint64_t n) {
+    if (!this->has_clock_index) this->build_clock_index();
+    if (n == 0 || n > this->clock_position.size()) {
+        log_error_and_exit("There are not enough clock events.");
+    }
+    return this->clock_position[n - 1];
 }
 
 bool TDCpp_data::is_clock(uint64_t index) const {
@@ -156,220 +453,70 @@ void TDCpp_data::find_n_fold_coincidences(uint16_t n,
                                         const char *singles_file_name,
                                         const char *coincidences_file_name,
                                         uint64_t coincidence_window,
-                                        bool legacyFormat) {
-
-    // Allocate and set to zero the array for single events.
-    uint64_t *singles = (uint64_t *) calloc(this->num_channels, sizeof(uint64_t));
-
-    // coincidence_channel is a pointer to an n-size array that is needed to keep
-    // track of the events inside a coincidence-window.
-    uint16_t *coincidence_channel = (uint16_t *) calloc(n, sizeof(uint16_t));
-
-    // A map that will hold the count of each possible coincidence.
-    std::map<std::string, uint64_t> coincidences_map;
-
-    uint16_t coincidence_channel_index = 1;
-    uint64_t coincidence_window_start = this->timestamp[0];
-    coincidence_channel[0] = this->channel[0];
-    singles[this->channel[0]] += 1;
-
-    bool is_coincidence_valid = true;
-    bool is_new_window_valid;
-    bool is_channel_acceptable;
-    std::string coincidence_key;
-
-    // For each event
-    for (uint64_t i = 1; i < this->size; ++i) {
-
-        // Increase the singles count
-        singles[this->channel[i]] += 1;
-
-        // If the event is in the coincidence window
-        if (this->timestamp[i] - coincidence_window_start <= coincidence_window) {
-
-            // If there have not been already too much events in this window
-            if (coincidence_channel_index < n) {
-                // Check if an event with the same channel as already been detected in this window
-                is_channel_acceptable = true;
-                for (uint16_t j = 0; j < coincidence_channel_index; ++j) {
-                    if (this->channel[i] == coincidence_channel[j]) {
-                        is_channel_acceptable = false;
-                    }
-                }
-
-                if (is_channel_acceptable) {
-                    // Add it to the coincidence
-                    coincidence_channel[coincidence_channel_index] = this->channel[i];
-                    coincidence_channel_index++;
-                } else {
-                    // Mark the coincidence as not valid
-                    is_coincidence_valid = false;
-                }
-            } else {
-                // Mark the coincidence as not valid, too many events.
-                is_coincidence_valid = false;
-            }
-        } else {
-            // If this event is too close to the last one, which closed the coincidence
-            // window, mark the coincidence, as well as the next window, not valid.
-            if (this->timestamp[i] - this->timestamp[i-1] <= coincidence_window) {
-                is_coincidence_valid = false;
-                is_new_window_valid  = false;
-            } else {
-                is_new_window_valid = true;
-            }
+                                        bool legacyFormat,
+                                        uint16_t num_threads) {
+    save_event_coincidences(tdcpp_event_arrays{this->timestamp, this->channel}, this->size, this->num_channels, n,
+                            singles_file_name, coincidences_file_name, std::vector<uint64_t>(1, coincidence_window),
+                            false, legacyFormat, num_threads);
+}
 
-            if (is_coincidence_valid) {
-                if (coincidence_channel_index == n) {
-                    // Sort the coincidence_channel array
-                    int32_t j;
-                    for (uint16_t k = 1; k < n; ++k) {
-                        uint16_t channel_value = coincidence_channel[k];
-                        j = k - 1;
-
-                        while ((j >= 0) && (coincidence_channel[j] > channel_value)) {
-                            coincidence_channel[j+1] = coincidence_channel[j];
-                            j = j - 1;
-                        }
-
-                        coincidence_channel[j+1] = channel_value;
-                    }
-
-                    //Generate a key for the coincidence and save it
-                    coincidence_key = "";
-
-                    if (!legacyFormat) {
-
-                        for (j = 0; j < n; ++j) {
-                            if (coincidence_channel[j] + 1 < 10) {
-                                coincidence_key.append("0");
-                            }
-                            coincidence_key.append(std::to_string(coincidence_channel[j] + 1));
-                            coincidence_key.append("_");
-                        }
-                        coincidence_key.pop_back();
-                        coincidences_map[coincidence_key] += 1;
-                    } else {
-                        for (j = 0; j < n; ++j) {
-                            coincidence_key.append(std::to_string(coincidence_channel[j] + 1));
-                            coincidence_key.append(" ");
-                        }
-                        coincidence_key.append("%");
-                        coincidences_map[coincidence_key] += 1;
-                    }
-                }
+void TDCpp_data::sweep_n_fold_coincidences(uint16_t n,
+                                         const char *singles_file_name,
+                                         const char *coincidences_file_name,
+                                         const std::vector<uint64_t> &coincidence_windows,
+                                         bool legacyFormat,
+                                         uint16_t num_threads) {
+    save_event_coincidences(tdcpp_event_arrays{this->timestamp, this->channel}, this->size, this->num_channels, n,
+                            singles_file_name, coincidences_file_name, coincidence_windows, true, legacyFormat,
+                            num_threads);
+}
+#pragma clang diagnostic pop
 
-            }
+void TDCpp_data::print_data_to_file(const char *output_file_path, uint16_t num_threads) {
+    // The channels are printed as in get_channel(), which only adds a constant to the stored ones.
+    const uint16_t channel_shift = this->size > 0 ? (uint16_t) (this->get_channel(0) - this->channel[0]) : 0;
+    print_events_to_file(tdcpp_event_arrays{this->timestamp, this->channel}, this->size, channel_shift,
+                         output_file_path, num_threads);
+}
 
-            // Start the new window
-            coincidence_window_start = this->timestamp[i];
-            coincidence_channel[0] = this->channel[i];
-            coincidence_channel_index = 1;
-            for (uint16_t j = 1; j < n; ++j) {
-                coincidence_channel[j] = 0;
-            }
+void TDCpp_data::set_channel_offset(const char *offset_file_path) {
+    int16_t *file_offset = (int16_t *) calloc(this->num_channels, sizeof(int16_t));
 
-            // Start the new window as already invalid, if that's the case
-            is_coincidence_valid = is_new_window_valid;
+    load_channel_offsets(offset_file_path, file_offset, this->num_channels);
+    this->set_channel_offset(file_offset);
 
-        }
-    }
+    free(file_offset);
+}
 
-    // Save the singles
-    char buffer[10000];
-    uint64_t buffer_cursor = 0;
+void TDCpp_data::set_channel_offset(const int16_t *channel_offset) {
+    TDCpp_stage_timer timer("offset_sort");
 
-    for (uint64_t channel_index = 0; channel_index < this->num_channels; ++channel_index) {
-        if (singles[channel_index] != 0) {
-            buffer_cursor +=
-                    sprintf(buffer + buffer_cursor, "%" PRIu64 "\t%" PRIu64 "\n", channel_index + 1, singles[channel_index]);
-        }
+    // Find the maximum negative offset
+    int16_t max_offset = 0;
+    for (uint16_t i = 0; i < this->num_channels; ++i) {
+        this->offset[i] = channel_offset[i];
+        if (max_offset > this->offset[i]) max_offset = this->offset[i];
     }
-    free(singles);
-
-    FILE *singles_file = fopen(singles_file_name, "w");
-    fprintf(singles_file, "%s", buffer);
-    fclose(singles_file);
-
-    //Reset the buffer
-    buffer_cursor = 0;
-    sprintf(buffer, "");
-
-    // Save the coincidences
-    for (auto const &map_entry : coincidences_map) {
-        if (!legacyFormat) {
-            buffer_cursor +=
-                    sprintf(buffer + buffer_cursor, "%s %" PRIu64 "\n", map_entry.first.c_str(), map_entry.second);
-        } else {
-            buffer_cursor +=
-                    sprintf(buffer + buffer_cursor, "%s\n", map_entry.first.c_str());
-        }
 
+    // Shift all the timestamp by their delay plus the maxiumum negative offset.
+    // We do this to ensure that all the timestamps are positive.
+    uint64_t *channel_shift = (uint64_t *) malloc(this->num_channels * sizeof(uint64_t));
+    for (uint16_t i = 0; i < this->num_channels; ++i) {
+        channel_shift[i] = (uint64_t) (-max_offset + this->offset[i]);
     }
-    free(coincidence_channel);
 
-    FILE *coincidences_file = fopen(coincidences_file_name, "w");
-    fprintf(coincidences_file, "%s", buffer);
-    fclose(coincidences_file);
-}
-#pragma clang diagnostic pop
-
-void TDCpp_data::print_data_to_file(const char *output_file_path) {
-    FILE *output_file = fopen(output_file_path, "w");
-    if (output_file) {
-        for (uint64_t i = 0; i < this->size; ++i) {
-            fprintf(output_file, "%" PRIu64 " %" PRIu16 "\n", this->timestamp[i], this->get_channel(i));
-        }
-    } else {
-        std::string error_string("Can't write to  ");
-        error_string.append(output_file_path);
-        log_error_and_exit(error_string.c_str());
+    for (uint64_t i = 0; i < this->size; ++i) {
+        this->timestamp[i] += channel_shift[this->channel[i]];
     }
 
-    fclose(output_file);
-}
-
-void TDCpp_data::set_channel_offset(const char *offset_file_path) {
-    FILE *offset_file = fopen(offset_file_path, "r");
-    int16_t max_offset = 0;
-
-    if (offset_file) {
-        // Find the maximum negative offset
-        for (uint16_t i = 0; i < this->num_channels; ++i) {
-            fscanf(offset_file, "%" PRId16 "", this->offset + i);
-            if (max_offset > this->offset[i]) max_offset = this->offset[i];
-        }
-
-        // Shift all the timestamp by their delay plus the maxiumum negative offset.
-        // We do this to ensure that all the timestamps are positive.
-        this->timestamp[0] += -max_offset + this->offset[this->channel[0]];
-
-        uint64_t sorting_timestamp;
-        uint16_t sorting_channel;
-        uint64_t j;
-
-
-        for (uint64_t i = 1; i < this->size; ++i) {
-            this->timestamp[i] += -max_offset + this->offset[this->channel[i]];
-            sorting_timestamp = this->timestamp[i];
-            sorting_channel = this->channel[i];
-            j = i - 1;
-            while ((j >= 0) && (this->timestamp[j] > sorting_timestamp)) {
-                this->timestamp[j + 1] = this->timestamp[j];
-                this->channel[j + 1] = this->channel[j];
-                j = j - 1;
-                this->timestamp[j + 1] = sorting_timestamp;
-                this->channel[j + 1] = sorting_channel;
-            }
-        }
+    // Each channel is still sorted, merge them back together.
+    sort_shifted_channels(this->timestamp, this->channel, this->size, channel_shift, this->num_channels);
+    timer.stop(this->size);
 
-    } else {
-        std::string error_string("Can't read offset file  ");
-        error_string.append(offset_file_path);
-        log_error_and_exit(error_string.c_str());
-    }
+    this->has_time_index = false;
+    this->build_clock_index();
 
-    fclose(offset_file);
+    free(channel_shift);
 }
 
 void TDCpp_data::copy_timestamp_array(uint64_t *dest_array, uint64_t start_index, uint64_t n_events) {
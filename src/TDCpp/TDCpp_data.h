@@ -6,7 +6,11 @@
 #include <cstdlib>
 #include <map>
 #include <cinttypes>
+#include <vector>
 #include "TDCpp_utils.h"
+#include "TDCpp_buffer.h"
+
+class TDCpp_view;
 
 /**
  * The timestamps file has a 40 byte header that has to be skipped
@@ -33,6 +37,18 @@
  * */
 #define TDCPP_ONE_SEC_BINS 12345679012
 
+/**
+ * The number of events in each block of the time index, see TDCpp_data::build_time_index().
+ * */
+#define TDCPP_TIME_INDEX_BLOCK_SIZE 1024
+
+/**
+ * The number of events that print_data_to_file() formats in one buffer.
+ * A line is at most 27 characters: 20 digits, a space, 5 digits and a newline.
+ * */
+#define TDCPP_PRINT_CHUNK_SIZE 262144
+#define TDCPP_PRINT_MAX_LINE_SIZE 27
+
 /**
  * @brief This class is used to read and use timestamps data from ID800-TDC.
  *
@@ -44,20 +60,28 @@ class TDCpp_data {
 
 protected:
     /**
-     * A pointer to the timestamp array.
+     * A pointer to the timestamp array, usually the one of #timestamp_buffer.
      * */
     uint64_t *timestamp;
 
     /**
-     * A pointer to the channel array.
+     * A pointer to the channel array, usually the one of #channel_buffer.
      * */
     uint16_t *channel;
 
     /**
-     * A pointer to the offset array.
+     * A pointer to the offset array, usually the one of #offset_buffer.
      * */
     int16_t *offset;
 
+    /**
+     * The arrays owned by the object. An object that shares the arrays of another one, like TDCpp_view,
+     * leaves them empty.
+     * */
+    TDCpp_buffer<uint64_t> timestamp_buffer;
+    TDCpp_buffer<uint16_t> channel_buffer;
+    TDCpp_buffer<int16_t> offset_buffer;
+
     /**
      * @brief The number of events in the object.
      *
@@ -82,6 +106,38 @@ protected:
      * */
     uint16_t box_number;
 
+    /**
+     * The smallest and the largest timestamp of each block of #TDCPP_TIME_INDEX_BLOCK_SIZE events.
+     * The largest ones are cumulative, i.e. they never decrease, so they can be searched.
+     * See build_time_index().
+     * */
+    std::vector<uint64_t> block_min_timestamp, block_max_timestamp;
+
+    /**
+     * True if #block_min_timestamp and #block_max_timestamp describe the current timestamps.
+     * */
+    bool has_time_index;
+
+    /**
+     * The index and the timestamp of each clock event, in order. See build_clock_index().
+     * */
+    std::vector<uint64_t> clock_position, clock_timestamp;
+
+    /**
+     * True if #clock_position and #clock_timestamp describe the current events.
+     * */
+    bool has_clock_index;
+
+    /**
+     * Allocate #timestamp_buffer and #channel_buffer and point #timestamp and #channel to them.
+     * The events are not initialized.
+     * @param n_events The number of events.
+     * @param num_threads The number of threads that first touch the pages, see TDCpp_buffer::allocate().
+     */
+    void allocate_events(uint64_t n_events, uint16_t num_threads = 1);
+
+    friend class TDCpp_view;
+
 public:
     /**
      * This is the default constructor.
@@ -91,7 +147,7 @@ public:
 
     /**
      * This is the default destructor.
-     * It frees the arrays.
+     * The arrays are freed with their buffers.
      * */
     virtual ~TDCpp_data();
 
@@ -107,6 +163,63 @@ public:
                         uint16_t clock,
                         uint16_t box_number);
 
+    /**
+     * This is an alternative to load_from_file().
+     * The file is memory-mapped and the records are copied straight from the mapping into the arrays,
+     * so that no intermediate read buffer is allocated. Peak memory is halved with respect to load_from_file().
+     *
+     * @param data_file_path The path of the timestamp file to be loaded.
+     * @param clock The channel that is going to be used as clock.
+     * @param box_number The number of the box the data come from.
+     */
+    void load_from_mapped_file(const char *data_file_path,
+                               uint16_t clock,
+                               uint16_t box_number);
+
+    /**
+     * Load the events from a binary event file, written by save_to_binary_file().
+     * The clock channel and the box number are read from the file as well.
+     *
+     * @param data_file_path The path of the binary event file to be loaded.
+     * @param num_threads The number of threads used to decode the blocks of the file.
+     */
+    void load_from_binary_file(const char *data_file_path, uint16_t num_threads = 1);
+
+    /**
+     * Load the events from a binary event file as load_from_binary_file() does, but without failing if the file
+     * is missing, truncated or corrupted, e.g. for a cached object that can be computed again.
+     *
+     * @param data_file_path The path of the binary event file to be loaded.
+     * @param num_threads The number of threads used to decode the blocks of the file.
+     * @return False if the file could not be loaded. The object then has no events.
+     */
+    bool try_load_from_binary_file(const char *data_file_path, uint16_t num_threads = 1);
+
+    /**
+     * Save the events in a binary event file, see tdcpp_binary_header for the format.
+     * The timestamps are delta encoded together with the channels, most events take 3 or 4 bytes.
+     * The events must be sorted, as they are after a merge or set_channel_offset().
+     *
+     * @param output_file_path The path of the binary event file.
+     * @return False if the file could not be written completely, e.g. because the disk is full.
+     * The incomplete file is removed.
+     */
+    bool save_to_binary_file(const char *output_file_path);
+
+    /**
+     * Build the time index, i.e. the smallest and largest timestamp of each block of events.
+     * It is built by find_time_index() when needed, and dropped when the timestamps change.
+     */
+    void build_time_index();
+
+    /**
+     * Find where a time falls in the events, in O(log n). The timestamps must be sorted, as they are after
+     * loading, merging or set_channel_offset().
+     * @param time The time to search for, in bins.
+     * @return The index of the first event at or after time, or get_size() if there is none.
+     */
+    uint64_t find_time_index(uint64_t time);
+
     /**
      * @param index The index of the event
      * @return The timestamp of the event
@@ -125,6 +238,21 @@ public:
      */
     virtual uint16_t get_channel(uint64_t index) const;
 
+    /**
+     * @return A pointer to the timestamp array, get_size() elements long.
+     */
+    const uint64_t *get_timestamp_array() const {
+        return timestamp;
+    }
+
+    /**
+     * @return A pointer to the channel array, get_size() elements long.
+     *      The channels are stored from 0 to max_channel-1, see get_channel() for the actual channel number.
+     */
+    const uint16_t *get_channel_array() const {
+        return channel;
+    }
+
     /**
      * @return The number of the box
      */
@@ -146,17 +274,41 @@ public:
         return clock;
     }
 
+    /**
+     * Build the clock index, i.e. the position and the timestamp of each clock event, in a single pass.
+     * It is built by the loading methods and set_channel_offset(), and by the methods below when needed.
+     */
+    void build_clock_index();
+
     /**
      * A method to retrieve the clock events and their number.
      * @param destination_array A pointer to an array that will be filled with the clock events.
-     *      Must be already allocated.
+     *      Must be already allocated, get_clock_number() elements long.
      * @return The number of clock events.
      */
     uint64_t get_clock_array(uint64_t *destination_array);
 
     /**
-     * @param n The number of clock event to search for.
-     * @return The index of the nth clock event.
+     * @return The timestamps of the clock events, get_clock_number() elements long. They are valid until the
+     * events change.
+     */
+    const uint64_t *get_clock_timestamps();
+
+    /**
+     * @return The number of clock events, in O(1).
+     */
+    uint64_t get_clock_number();
+
+    /**
+     * @param start_index The first event to consider.
+     * @param end_index The event after the last one to consider.
+     * @return The number of clock events between the two, in O(log n).
+     */
+    uint64_t count_clocks(uint64_t start_index, uint64_t end_index);
+
+    /**
+     * @param n The number of clock event to search for, starting from 1.
+     * @return The index of the nth clock event, in O(1).
      */
     uint64_t find_nth_clock(uint64_t n);
 
@@ -184,29 +336,59 @@ public:
      * @param coincidence_window The maximum time distance *in bins* in which two
      *      or more events are considered coincident.
      * @param legacyFormat Use and alternative printing standard, for compatibility.
+     * @param num_threads The number of threads to use. The events are split in time slices at gaps bigger than
+     *      the coincidence window, each slice is counted by its own thread, the result is the same as with one thread.
      */
     void find_n_fold_coincidences(uint16_t n,
                                   const char *singles_file_name,
                                   const char *coincidences_file_name,
                                   uint64_t coincidence_window,
-                                  bool legacyFormat = false);
+                                  bool legacyFormat = false,
+                                  uint16_t num_threads = 1);
 
     /**
-     * Print to file the timestamps and relative channels in the object.
+     * @brief This method finds n-fold coincidences in the object for many coincidence windows at once.
+     * The events are read only once, whatever the number of windows. The result for each window is the same
+     * as find_n_fold_coincidences() and it is saved in files whose names have the window appended, e.g.
+     * singles.temp becomes singles_25.temp for a window of 25 bins.
+     * @param n The *exact* number of events that must occur at the same time (modulo coincidence_window).
+     * @param singles_file_name The name of the files in which the single events count will be saved.
+     * @param coincidences_file_name The name of the files in which the coincidence events will be saved.
+     * @param coincidence_windows The coincidence windows, *in bins*.
+     * @param legacyFormat Use and alternative printing standard, for compatibility.
+     * @param num_threads The number of threads to use.
+     */
+    void sweep_n_fold_coincidences(uint16_t n,
+                                   const char *singles_file_name,
+                                   const char *coincidences_file_name,
+                                   const std::vector<uint64_t> &coincidence_windows,
+                                   bool legacyFormat = false,
+                                   uint16_t num_threads = 1);
+
+    /**
+     * Print to file the timestamps and relative channels in the object, one event per line.
+     * The events are formatted in chunks of #TDCPP_PRINT_CHUNK_SIZE, in parallel, and each chunk is written at once.
      * @param output_file_path The name of the output file.
+     * @param num_threads The number of threads used to format the events.
      */
-    void print_data_to_file(const char *output_file_path);
+    void print_data_to_file(const char *output_file_path, uint16_t num_threads = 1);
 
     /**
-     * @brief Set an offset per channel and reorder data if necessary.
-     *
-     * We are using the Insertion Sort algorithm, which is O(n^2) in the worse-case, but is
-     * roughly O(n) if the array is nearly sorted (which is our case). A visual comparison of
-     * sorting algorithm can be found at https://www.toptal.com/developers/sorting-algorithms
+     * @brief Set an offset per channel, read from a file, and reorder data if necessary.
      * @param offset_file_path The name of the offset file.
      */
     void set_channel_offset(const char *offset_file_path);
 
+    /**
+     * @brief Set an offset per channel and reorder data if necessary.
+     *
+     * A constant offset keeps the events of each channel sorted, so the channels are split apart and
+     * joined back with a k-way merge, see sort_shifted_channels(). This is O(n log k), no matter how
+     * big the offsets are with respect to the time between events.
+     * @param channel_offset The offset of each channel, in bins. It must hold get_channels_number() elements.
+     */
+    void set_channel_offset(const int16_t *channel_offset);
+
     /**
      * Copy the timestamp array to dest_array
      * @param dest_array Destination array. If this is not big enough segmentation fault will occur.
@@ -216,6 +398,21 @@ public:
     void copy_timestamp_array(uint64_t* dest_array, uint64_t start_index, uint64_t n_events);
 
 private:
+    /**
+     * Load the events from a binary event file, see load_from_binary_file().
+     * @param data_file_path The path of the binary event file to be loaded.
+     * @param num_threads The number of threads used to decode the blocks of the file.
+     * @return The description of the error, empty if the file was loaded.
+     */
+    std::string read_binary_file(const char *data_file_path, uint16_t num_threads);
+
+    /**
+     * Set the members that do not depend on the content of the file. It is called by the loading methods.
+     * @param clock The channel that is going to be used as clock.
+     * @param box_number The number of the box the data come from.
+     */
+    void init_box(uint16_t clock, uint16_t box_number);
+
     /**
      * This method finds the number of events inside the file.
      * @param data_file A pointer to an open file.
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <immintrin.h>
+#include "TDCpp_drift.h"
+
+typedef void (*correct_drift_function)(const uint64_t *, uint64_t, uint64_t *, uint64_t, uint64_t, int64_t, uint64_t);
+
+int64_t drift_correction_fixed_point(uint64_t box_delta, uint64_t reference_delta) {
+    __int128 difference = ((__int128) reference_delta - (__int128) box_delta) << TDCPP_DRIFT_FRACTION_BITS;
+    __int128 half_delta = (__int128) (box_delta / 2);
+    return (int64_t) ((difference >= 0 ? difference + half_delta : difference - half_delta) / (__int128) box_delta);
+}
+
+void correct_drift_scalar(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                          uint64_t knot, uint64_t reference_knot, int64_t correction, uint64_t limit) {
+    // Work on the magnitude, so that the shift truncates towards zero for both signs.
+    const uint64_t magnitude = (uint64_t) (correction < 0 ? -correction : correction);
+    for (uint64_t i = 0; i < size; ++i) {
+        uint64_t elapsed = timestamp[i] - knot;
+        uint64_t scaled = (uint64_t) (((unsigned __int128) elapsed * magnitude) >> TDCPP_DRIFT_FRACTION_BITS);
+        uint64_t corrected = reference_knot + elapsed + (correction < 0 ? -scaled : scaled);
+        destination[i] = corrected < limit ? corrected : limit;
+    }
+}
+
+__attribute__((target("avx2")))
+void correct_drift_avx2(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                        uint64_t knot, uint64_t reference_knot, int64_t correction, uint64_t limit) {
+    // AVX2 only multiplies 32bit halves. With elapsed = high * 2^32 + low, the scaled value is
+    // high * magnitude + (low * magnitude) >> 32. Both products are of two 32bit factors, so they fit in 64 bits,
+    // and their sum is the exact (elapsed * magnitude) >> 32, which is less than elapsed since magnitude < 2^32.
+    const uint64_t magnitude = (uint64_t) (correction < 0 ? -correction : correction);
+    const __m256i knots = _mm256_set1_epi64x((long long) knot);
+    const __m256i reference_knots = _mm256_set1_epi64x((long long) reference_knot);
+    const __m256i magnitudes = _mm256_set1_epi64x((long long) magnitude);
+    // All ones for a negative correction, (x ^ sign) - sign negates x in that case.
+    const __m256i sign = _mm256_set1_epi64x(correction < 0 ? -1LL : 0LL);
+    const __m256i limits = _mm256_set1_epi64x((long long) limit);
+    uint64_t i = 0;
+
+    for (; i + 4 <= size; i += 4) {
+        __m256i elapsed = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *) (timestamp + i)), knots);
+        __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(elapsed, 32), magnitudes);
+        __m256i low = _mm256_srli_epi64(_mm256_mul_epu32(elapsed, magnitudes), TDCPP_DRIFT_FRACTION_BITS);
+        __m256i scaled = _mm256_sub_epi64(_mm256_xor_si256(_mm256_add_epi64(high, low), sign), sign);
+        __m256i result = _mm256_add_epi64(_mm256_add_epi64(reference_knots, elapsed), scaled);
+        // There is no 64bit minimum in AVX2. The timestamps are less than 2^63, so the signed comparison works.
+        result = _mm256_blendv_epi8(result, limits, _mm256_cmpgt_epi64(result, limits));
+        _mm256_storeu_si256((__m256i *) (destination + i), result);
+    }
+
+    correct_drift_scalar(timestamp + i, size - i, destination + i, knot, reference_knot, correction, limit);
+}
+
+/**
+ * @return The fastest kernel supported by the CPU.
+ */
+static correct_drift_function select_kernel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return correct_drift_avx2;
+    return correct_drift_scalar;
+}
+
+void correct_drift(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                   uint64_t knot, uint64_t reference_knot, int64_t correction, uint64_t limit) {
+    static const correct_drift_function kernel = select_kernel();
+    if (size == 0) return;
+
+    // The vector kernel needs the magnitude of the correction in 32 bits, the elapsed time can be anything.
+    bool fits_vector = correction < (1LL << 32) && correction > -(1LL << 32);
+    if (fits_vector) {
+        kernel(timestamp, size, destination, knot, reference_knot, correction, limit);
+    } else {
+        correct_drift_scalar(timestamp, size, destination, knot, reference_knot, correction, limit);
+    }
+}
+
+void correct_drift_segments(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                            const uint64_t *knots, const uint64_t *reference_knots, const int64_t *corrections,
+                            uint64_t num_knots) {
+    if (size == 0) return;
+
+    // Find the segment of the first timestamp, then move forward one segment at a time.
+    uint64_t k = (uint64_t) (std::upper_bound(knots, knots + num_knots, timestamp[0]) - knots);
+    if (k > 0) k--;
+
+    uint64_t i = 0;
+    while (i < size) {
+        uint64_t end = size, limit = TDCPP_DRIFT_NO_LIMIT;
+        if (k + 1 < num_knots) {
+            end = (uint64_t) (std::lower_bound(timestamp + i, timestamp + size, knots[k + 1]) - timestamp);
+            limit = reference_knots[k + 1];
+        }
+        correct_drift(timestamp + i, end - i, destination + i, knots[k], reference_knots[k], corrections[k], limit);
+        i = end;
+        k++;
+    }
+}
+
+const char *correct_drift_kernel() {
+    return select_kernel() == correct_drift_avx2 ? "avx2" : "scalar";
+}
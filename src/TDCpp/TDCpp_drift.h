@@ -0,0 +1,83 @@
+#ifndef TDCPP_DRIFT_H
+#define TDCPP_DRIFT_H
+
+#include <stdint-gcc.h>
+
+/**
+ * The number of fractional bits of the fixed-point drift corrections.
+ */
+#define TDCPP_DRIFT_FRACTION_BITS 32
+
+/**
+ * The limit to pass to correct_drift() when the corrected timestamps are not capped, e.g. after the last knot.
+ * The vector kernel compares signed values, so this is the largest signed one.
+ */
+#define TDCPP_DRIFT_NO_LIMIT ((uint64_t) INT64_MAX)
+
+/**
+ * Convert the drift between two matched clock deltas into a fixed-point correction, with
+ * #TDCPP_DRIFT_FRACTION_BITS fractional bits, rounded to the nearest.
+ * @param box_delta The time between two clock events, in the time of the object to correct.
+ * @param reference_delta The time between the same clock events, in the time of the reference.
+ * @return The correction (reference_delta - box_delta) / box_delta, in fixed-point.
+ */
+int64_t drift_correction_fixed_point(uint64_t box_delta, uint64_t reference_delta);
+
+/**
+ * Shift and scale sorted timestamps into the time of the reference, within one segment of the drift model:
+ * destination = reference_knot + e + e * correction, with e = timestamp - knot.
+ * The product is truncated towards zero, as the previous floating point version did. Since the correction is
+ * rounded to 2^-33, the result differs from the exact one by at most 1 bin plus e / 2^33 bins, i.e. less than
+ * 2 bins for segments shorter than a second.
+ * The results are capped at limit, the start of the next segment in the time of the reference, so that the rounding
+ * can't put an event after the clock that follows it: sorted timestamps stay sorted once corrected.
+ * The fastest kernel supported by the CPU (AVX2 or scalar) is chosen at runtime, the first time
+ * this function is called.
+ *
+ * @param timestamp The timestamps to correct, none of them before knot.
+ * @param size The number of timestamps.
+ * @param destination The corrected timestamps. Must be already allocated.
+ * @param knot The clock event where the segment starts, in the time of the object.
+ * @param reference_knot The same clock event, in the time of the reference.
+ * @param correction The fixed-point correction, see drift_correction_fixed_point().
+ * @param limit The largest corrected timestamp, at most #TDCPP_DRIFT_NO_LIMIT.
+ */
+void correct_drift(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                   uint64_t knot, uint64_t reference_knot, int64_t correction, uint64_t limit);
+
+/**
+ * Scalar version of correct_drift(), it is the fallback for older CPUs and for corrections of 100% or more.
+ */
+void correct_drift_scalar(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                          uint64_t knot, uint64_t reference_knot, int64_t correction, uint64_t limit);
+
+/**
+ * AVX2 version of correct_drift(). The CPU must support AVX2, and the magnitude of the correction must be less
+ * than 2^32, i.e. 100%. The elapsed time is not limited.
+ */
+void correct_drift_avx2(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                        uint64_t knot, uint64_t reference_knot, int64_t correction, uint64_t limit);
+
+/**
+ * Correct a range of sorted timestamps with a piecewise linear drift model, calling correct_drift() once
+ * per segment. The timestamps after the last knot use the last correction.
+ * The sorted timestamps of the object stay sorted once corrected.
+ *
+ * @param timestamp The timestamps to correct, none of them before knots[0].
+ * @param size The number of timestamps.
+ * @param destination The corrected timestamps. Must be already allocated.
+ * @param knots The clock events where each segment starts, in the time of the object, sorted.
+ * @param reference_knots The same clock events, in the time of the reference.
+ * @param corrections The fixed-point correction of each segment.
+ * @param num_knots The number of segments, at least one.
+ */
+void correct_drift_segments(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                            const uint64_t *knots, const uint64_t *reference_knots, const int64_t *corrections,
+                            uint64_t num_knots);
+
+/**
+ * @return The name of the kernel used by correct_drift(), i.e. "avx2" or "scalar".
+ */
+const char *correct_drift_kernel();
+
+#endif //TDCPP_DRIFT_H
@@ -0,0 +1,144 @@
+#include <cstdio>
+#include <cstdlib>
+#include "TDCpp_events.h"
+#include "TDCpp_data.h"
+#include "TDCpp_counter.h"
+#include "TDCpp_metrics.h"
+
+template<class Events>
+std::vector<TDCpp_coincidence_counter *> count_event_coincidences(const Events &events, uint64_t size,
+                                                                  uint16_t num_channels, uint16_t n,
+                                                                  const std::vector<uint64_t> &coincidence_windows,
+                                                                  bool legacyFormat, uint16_t num_threads) {
+    const uint64_t num_windows = coincidence_windows.size();
+    uint64_t max_coincidence_window = 0;
+    for (uint64_t w = 0; w < num_windows; ++w) {
+        if (coincidence_windows[w] > max_coincidence_window) max_coincidence_window = coincidence_windows[w];
+    }
+
+    // Split the events in slices that do not share any coincidence window, for all the windows.
+    std::vector<uint64_t> slice_start =
+            TDCpp_coincidence_counter::split_at_gaps(events, size, max_coincidence_window,
+                                                     num_threads > 0 ? num_threads : 1);
+    uint64_t num_slices = slice_start.size() - 1;
+
+    // One counter per window, for each slice.
+    std::vector<std::vector<TDCpp_coincidence_counter *> > counters(num_slices);
+    for (uint64_t s = 0; s < num_slices; ++s) {
+        for (uint64_t w = 0; w < num_windows; ++w) {
+            counters[s].push_back(new TDCpp_coincidence_counter(n, num_channels, coincidence_windows[w],
+                                                                legacyFormat));
+        }
+    }
+
+    auto count_slice = [&events, &counters, &slice_start, num_slices](uint64_t s) {
+        TDCpp_coincidence_counter::process(counters[s], events, slice_start[s], slice_start[s + 1]);
+        // The gap after the slice closes its last window.
+        if (s + 1 < num_slices) {
+            for (auto counter : counters[s]) counter->close_window();
+        }
+    };
+    run_tasks(num_slices, count_slice);
+
+    // Reduce the counts of all the slices in the first one.
+    for (uint64_t s = 1; s < num_slices; ++s) {
+        for (uint64_t w = 0; w < num_windows; ++w) {
+            counters[0][w]->add(*counters[s][w]);
+            delete counters[s][w];
+        }
+    }
+
+    return counters[0];
+}
+
+template<class Events>
+void save_event_coincidences(const Events &events, uint64_t size, uint16_t num_channels, uint16_t n,
+                             const char *singles_file_name, const char *coincidences_file_name,
+                             const std::vector<uint64_t> &coincidence_windows, bool is_sweep, bool legacyFormat,
+                             uint16_t num_threads) {
+    TDCpp_stage_timer timer("counting");
+
+    std::vector<TDCpp_coincidence_counter *> counters =
+            count_event_coincidences(events, size, num_channels, n, coincidence_windows, legacyFormat, num_threads);
+
+    for (uint64_t w = 0; w < coincidence_windows.size(); ++w) {
+        if (is_sweep) {
+            counters[w]->save(window_file_name(singles_file_name, coincidence_windows[w]).c_str(),
+                              window_file_name(coincidences_file_name, coincidence_windows[w]).c_str());
+        } else {
+            counters[w]->save(singles_file_name, coincidences_file_name);
+        }
+        delete counters[w];
+    }
+
+    timer.stop(size);
+}
+
+template<class Events>
+void print_events_to_file(const Events &events, uint64_t size, uint16_t channel_shift, const char *output_file_path,
+                          uint16_t num_threads) {
+    TDCpp_stage_timer timer("output");
+    uint64_t written_bytes = 0;
+
+    FILE *output_file = fopen(output_file_path, "w");
+    if (!output_file) {
+        std::string error_string("Can't write to  ");
+        error_string.append(output_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    if (num_threads == 0) num_threads = 1;
+
+    // Each thread formats one chunk in its own buffer, then the chunks are written in order.
+    std::vector<TDCpp_buffer<char> > buffers(num_threads);
+    std::vector<uint64_t> lengths(num_threads);
+    for (uint16_t t = 0; t < num_threads; ++t) {
+        if (buffers[t].allocate(TDCPP_PRINT_CHUNK_SIZE * TDCPP_PRINT_MAX_LINE_SIZE) == nullptr) {
+            log_error_and_exit("Could not allocate the memory to write a file.");
+        }
+    }
+
+    for (uint64_t start = 0; start < size; start += (uint64_t) num_threads * TDCPP_PRINT_CHUNK_SIZE) {
+        uint16_t num_chunks = 1;
+        while (num_chunks < num_threads && start + num_chunks * TDCPP_PRINT_CHUNK_SIZE < size) num_chunks++;
+
+        auto format_chunk = [&](uint64_t t) {
+            uint64_t first = start + t * TDCPP_PRINT_CHUNK_SIZE;
+            uint64_t end = size - first < TDCPP_PRINT_CHUNK_SIZE ? size : first + TDCPP_PRINT_CHUNK_SIZE;
+            char *position = buffers[t].data();
+            for (uint64_t i = first; i < end; ++i) {
+                position = format_u64(position, events.get_timestamp(i));
+                *position++ = ' ';
+                position = format_u64(position, (uint16_t) (events.get_channel(i) + channel_shift));
+                *position++ = '\n';
+            }
+            lengths[t] = (uint64_t) (position - buffers[t].data());
+        };
+        run_tasks(num_chunks, format_chunk);
+
+        for (uint16_t t = 0; t < num_chunks; ++t) {
+            fwrite(buffers[t].data(), 1, lengths[t], output_file);
+            written_bytes += lengths[t];
+        }
+    }
+
+    fclose(output_file);
+
+    timer.stop(size, written_bytes);
+}
+
+// The accessors of TDCpp_data and TDCpp_packed.
+template std::vector<TDCpp_coincidence_counter *> count_event_coincidences<tdcpp_event_arrays>(
+        const tdcpp_event_arrays &, uint64_t, uint16_t, uint16_t, const std::vector<uint64_t> &, bool, uint16_t);
+template std::vector<TDCpp_coincidence_counter *> count_event_coincidences<tdcpp_packed_events>(
+        const tdcpp_packed_events &, uint64_t, uint16_t, uint16_t, const std::vector<uint64_t> &, bool, uint16_t);
+template void save_event_coincidences<tdcpp_event_arrays>(
+        const tdcpp_event_arrays &, uint64_t, uint16_t, uint16_t, const char *, const char *,
+        const std::vector<uint64_t> &, bool, bool, uint16_t);
+template void save_event_coincidences<tdcpp_packed_events>(
+        const tdcpp_packed_events &, uint64_t, uint16_t, uint16_t, const char *, const char *,
+        const std::vector<uint64_t> &, bool, bool, uint16_t);
+template void print_events_to_file<tdcpp_event_arrays>(
+        const tdcpp_event_arrays &, uint64_t, uint16_t, const char *, uint16_t);
+template void print_events_to_file<tdcpp_packed_events>(
+        const tdcpp_packed_events &, uint64_t, uint16_t, const char *, uint16_t);
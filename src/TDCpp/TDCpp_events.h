@@ -0,0 +1,138 @@
+#ifndef TDCPP_EVENTS_H
+#define TDCPP_EVENTS_H
+
+#include <stdint-gcc.h>
+#include <vector>
+
+class TDCpp_coincidence_counter;
+
+/**
+ * A packed event is a single word: the timestamp in the upper 56 bits, the channel in the lower 8 bits.
+ * Comparing two packed events compares their timestamps first, then their channels.
+ * */
+#define TDCPP_PACKED_CHANNEL_BITS 8
+#define TDCPP_PACKED_CHANNEL_MASK 0xFF
+
+/**
+ * The number of channels that fit in a packed event.
+ * */
+#define TDCPP_PACKED_MAX_CHANNELS 256
+
+/**
+ * The largest timestamp that fits in a packed event, about 67 days of acquisition.
+ * */
+#define TDCPP_PACKED_MAX_TIMESTAMP ((((uint64_t) 1) << (64 - TDCPP_PACKED_CHANNEL_BITS)) - 1)
+
+/**
+ * @return The packed event with the given timestamp and channel.
+ */
+inline uint64_t pack_event(uint64_t timestamp, uint16_t channel) {
+    return (timestamp << TDCPP_PACKED_CHANNEL_BITS) | channel;
+}
+
+/**
+ * @return The timestamp of a packed event.
+ */
+inline uint64_t packed_timestamp(uint64_t event) {
+    return event >> TDCPP_PACKED_CHANNEL_BITS;
+}
+
+/**
+ * @return The channel of a packed event, as stored, i.e. from 0 to num_channels-1.
+ */
+inline uint16_t packed_channel(uint64_t event) {
+    return (uint16_t) (event & TDCPP_PACKED_CHANNEL_MASK);
+}
+
+/**
+ * @brief The events of a TDCpp_data object, an array of timestamps next to an array of channels.
+ *
+ * The algorithms that only read the events, i.e. the counting and the printing below, take them through an
+ * accessor with get_timestamp() and get_channel(), so the same code runs on TDCpp_data and TDCpp_packed.
+ * The algorithms are defined in the .cpp files, and instantiated for each accessor, so that the accessors are
+ * inlined in the loops over the events.
+ */
+struct tdcpp_event_arrays {
+    /** The timestamps of the events. */
+    const uint64_t *timestamp;
+    /** The channels of the events, as stored, i.e. from 0 to num_channels-1. */
+    const uint16_t *channel;
+
+    uint64_t get_timestamp(uint64_t index) const {
+        return timestamp[index];
+    }
+
+    uint16_t get_channel(uint64_t index) const {
+        return channel[index];
+    }
+};
+
+/**
+ * @brief The events of a TDCpp_packed object, see pack_event() and tdcpp_event_arrays.
+ */
+struct tdcpp_packed_events {
+    /** The packed events. */
+    const uint64_t *events;
+
+    uint64_t get_timestamp(uint64_t index) const {
+        return packed_timestamp(events[index]);
+    }
+
+    uint16_t get_channel(uint64_t index) const {
+        return packed_channel(events[index]);
+    }
+};
+
+/**
+ * Count single events and n-fold coincidences for many coincidence windows, in one pass over the events.
+ * The events are split in time slices at gaps bigger than the largest window, and each slice is counted by its own
+ * thread, see TDCpp_coincidence_counter::split_at_gaps().
+ * @param events The events, sorted.
+ * @param size The number of events.
+ * @param num_channels The number of channels of the events.
+ * @param n The *exact* number of events that must occur at the same time.
+ * @param coincidence_windows The coincidence windows, *in bins*.
+ * @param legacyFormat Use and alternative printing standard, for compatibility.
+ * @param num_threads The number of threads to use, the result is the same as with one thread.
+ * @return A counter per coincidence window, they must be deleted by the caller.
+ */
+template<class Events>
+std::vector<TDCpp_coincidence_counter *> count_event_coincidences(const Events &events, uint64_t size,
+                                                                  uint16_t num_channels, uint16_t n,
+                                                                  const std::vector<uint64_t> &coincidence_windows,
+                                                                  bool legacyFormat, uint16_t num_threads);
+
+/**
+ * Count single events and n-fold coincidences for many coincidence windows, as count_event_coincidences() does,
+ * and save the counts of each window, see TDCpp_data::sweep_n_fold_coincidences().
+ * @param events The events, sorted.
+ * @param size The number of events.
+ * @param num_channels The number of channels of the events.
+ * @param n The *exact* number of events that must occur at the same time.
+ * @param singles_file_name The name of the file in which the single events count will be saved.
+ * @param coincidences_file_name The name of the file in which the coincidence events will be saved.
+ * @param coincidence_windows The coincidence windows, *in bins*.
+ * @param is_sweep True to append the window to the file names, see window_file_name(). Otherwise there must be
+ *      a single window, saved in the given files.
+ * @param legacyFormat Use and alternative printing standard, for compatibility.
+ * @param num_threads The number of threads to use.
+ */
+template<class Events>
+void save_event_coincidences(const Events &events, uint64_t size, uint16_t num_channels, uint16_t n,
+                             const char *singles_file_name, const char *coincidences_file_name,
+                             const std::vector<uint64_t> &coincidence_windows, bool is_sweep, bool legacyFormat,
+                             uint16_t num_threads);
+
+/**
+ * Print to file the timestamps and channels of the events, one event per line, see TDCpp_data::print_data_to_file().
+ * @param events The events.
+ * @param size The number of events.
+ * @param channel_shift Added to the stored channels to get the printed ones, see TDCpp_data::get_channel().
+ * @param output_file_path The name of the output file.
+ * @param num_threads The number of threads used to format the events.
+ */
+template<class Events>
+void print_events_to_file(const Events &events, uint64_t size, uint16_t channel_shift, const char *output_file_path,
+                          uint16_t num_threads);
+
+#endif //TDCPP_EVENTS_H
@@ -0,0 +1,186 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "TDCpp_follow.h"
+#include "TDCpp_counter.h"
+
+volatile sig_atomic_t TDCpp_follow::stop_requested = 0;
+
+/**
+ * Save the counts to temporary files, then move them in place, so that a reader never sees a partial file.
+ */
+static void publish_counts(const TDCpp_coincidence_counter &counter,
+                           const char *singles_file_name, const char *coincidences_file_name) {
+    const std::string singles_temporary = std::string(singles_file_name) + ".tmp";
+    const std::string coincidences_temporary = std::string(coincidences_file_name) + ".tmp";
+
+    counter.save(singles_temporary.c_str(), coincidences_temporary.c_str());
+
+    if (rename(singles_temporary.c_str(), singles_file_name) != 0 ||
+        rename(coincidences_temporary.c_str(), coincidences_file_name) != 0) {
+        log_error_and_exit("Could not publish the counts.");
+    }
+}
+
+TDCpp_follow::TDCpp_follow(const char *data_file_path, uint16_t clock, uint16_t box_number, uint64_t chunk_size)
+        : TDCpp_stream(clock, box_number, chunk_size) {
+    this->data_file_path = data_file_path;
+    this->data_file_descriptor = -1;
+
+    if (this->record_buffer.allocate(this->chunk_size * TDCPP_RECORD_SIZE) == nullptr) {
+        log_error_and_exit("Could not allocate the memory to read a file.");
+    }
+
+    // Without inotify the file is polled every TDCPP_FOLLOW_POLL_INTERVAL.
+    this->notify_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    this->open_file();
+}
+
+TDCpp_follow::~TDCpp_follow() {
+    if (this->data_file_descriptor >= 0) close(this->data_file_descriptor);
+    if (this->notify_descriptor >= 0) close(this->notify_descriptor);
+}
+
+bool TDCpp_follow::open_file() {
+    if (this->data_file_descriptor >= 0) return true;
+
+    this->data_file_descriptor = open(this->data_file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->data_file_descriptor < 0) return false;
+
+    if (this->notify_descriptor >= 0 &&
+        inotify_add_watch(this->notify_descriptor, this->data_file_path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        close(this->notify_descriptor);
+        this->notify_descriptor = -1;
+    }
+
+    return true;
+}
+
+uint64_t TDCpp_follow::get_available_records() {
+    if (!this->open_file()) return 0;
+
+    struct stat file_stat;
+    if (fstat(this->data_file_descriptor, &file_stat) != 0) {
+        std::string error_string("Could not stat the file ");
+        error_string.append(this->data_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    // The last record may still be partially written, it is read the next time.
+    if ((uint64_t) file_stat.st_size < TDCPP_HEADER_SIZE) return 0;
+    uint64_t file_records = ((uint64_t) file_stat.st_size - TDCPP_HEADER_SIZE) / TDCPP_RECORD_SIZE;
+
+    if (file_records < this->read_index) {
+        std::string error_string("The file was truncated while following it, ");
+        error_string.append(this->data_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    return file_records - this->read_index;
+}
+
+uint64_t TDCpp_follow::read_chunk(uint64_t n_records) {
+    const uint64_t n_bytes = n_records * TDCPP_RECORD_SIZE;
+    const off_t start = (off_t) (TDCPP_HEADER_SIZE + this->read_index * TDCPP_RECORD_SIZE);
+
+    uint64_t read_bytes = 0;
+    while (read_bytes < n_bytes) {
+        ssize_t result = pread(this->data_file_descriptor, this->record_buffer.data() + read_bytes,
+                               n_bytes - read_bytes, start + (off_t) read_bytes);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) {
+            std::string error_string("Could not read the file ");
+            error_string.append(this->data_file_path);
+            log_error_and_exit(error_string.c_str());
+        }
+        read_bytes += (uint64_t) result;
+    }
+
+    this->start_chunk();
+    return this->append_records(this->record_buffer.data(), n_records);
+}
+
+void TDCpp_follow::wait_for_change(int timeout) {
+    if (this->notify_descriptor < 0 || this->data_file_descriptor < 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+        return;
+    }
+
+    struct pollfd notify_poll;
+    notify_poll.fd = this->notify_descriptor;
+    notify_poll.events = POLLIN;
+    notify_poll.revents = 0;
+
+    if (poll(&notify_poll, 1, timeout) > 0) {
+        // Only the wake up matters, the size of the file is checked anyway.
+        char events[4096];
+        while (read(this->notify_descriptor, events, sizeof(events)) > 0);
+    }
+}
+
+void TDCpp_follow::follow_n_fold_coincidences(uint16_t n,
+                                              const char *singles_file_name,
+                                              const char *coincidences_file_name,
+                                              uint64_t coincidence_window,
+                                              double publish_interval,
+                                              double idle_timeout,
+                                              bool legacyFormat) {
+
+    TDCpp_coincidence_counter counter(n, this->num_channels, coincidence_window, legacyFormat);
+
+    auto last_publish_time = std::chrono::steady_clock::now();
+    auto last_growth_time = last_publish_time;
+    uint64_t last_publish_index = this->read_index;
+
+    while (!stop_requested) {
+        uint64_t available_records = this->get_available_records();
+
+        if (available_records > 0) {
+            if (available_records > this->chunk_size) available_records = this->chunk_size;
+
+            // The counter keeps the open window between the chunks.
+            uint64_t chunk_events = this->read_chunk(available_records);
+            counter.process(this->timestamp, this->channel, chunk_events);
+
+            last_growth_time = std::chrono::steady_clock::now();
+        } else {
+            std::chrono::duration<double> idle_time = std::chrono::steady_clock::now() - last_growth_time;
+            if (idle_timeout > 0 && idle_time.count() >= idle_timeout) break;
+
+            // Do not sleep past the next publication.
+            std::chrono::duration<double> since_publish = std::chrono::steady_clock::now() - last_publish_time;
+            double until_publish = (publish_interval - since_publish.count()) * 1000;
+            int timeout = TDCPP_FOLLOW_POLL_INTERVAL;
+            if (until_publish < timeout) timeout = until_publish > 0 ? (int) until_publish : 0;
+
+            this->wait_for_change(timeout);
+        }
+
+        std::chrono::duration<double> since_publish = std::chrono::steady_clock::now() - last_publish_time;
+        if (since_publish.count() >= publish_interval) {
+            publish_counts(counter, singles_file_name, coincidences_file_name);
+
+            std::cout << "Followed " << this->read_index << " events, "
+                      << (this->read_index - last_publish_index) / since_publish.count() << " events/s" << std::endl;
+
+            last_publish_time = std::chrono::steady_clock::now();
+            last_publish_index = this->read_index;
+        }
+    }
+
+    // No more records are coming, count the events that were held back.
+    this->start_chunk();
+    uint64_t chunk_events = this->flush_chunk();
+    counter.process(this->timestamp, this->channel, chunk_events);
+
+    publish_counts(counter, singles_file_name, coincidences_file_name);
+    std::cout << "Followed " << this->read_index << " events in total" << std::endl;
+}
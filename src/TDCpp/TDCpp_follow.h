@@ -0,0 +1,128 @@
+#ifndef TDCPP_FOLLOW_H
+#define TDCPP_FOLLOW_H
+
+#include <csignal>
+#include <string>
+#include "TDCpp_stream.h"
+
+/**
+ * The longest time, in milliseconds, between two checks of the size of the file.
+ * It is the only way to notice new records if the file can not be watched, e.g. on a network file system.
+ */
+#define TDCPP_FOLLOW_POLL_INTERVAL 100
+
+/**
+ * @brief This class follows a timestamp file from ID800-TDC while it is still being written, like tail -f.
+ *
+ * The file is watched with inotify, or polled if that is not possible. Only the complete records that were
+ * appended since the last read are decoded, in chunks of at most chunk_size records, so the whole file is never
+ * read again. The channel offsets are applied as in TDCpp_stream: the events that could still be overtaken by
+ * the next records are held back until they can not.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_follow : public TDCpp_stream {
+
+protected:
+    /**
+     * The path of the followed file.
+     */
+    std::string data_file_path;
+
+    /**
+     * The descriptor of the followed file, or -1 until the file exists.
+     */
+    int data_file_descriptor;
+
+    /**
+     * The inotify instance, or -1 if the file is polled.
+     */
+    int notify_descriptor;
+
+    /**
+     * A buffer for the packed records of a chunk.
+     */
+    TDCpp_buffer<char> record_buffer;
+
+    /**
+     * Set by request_stop(), to stop following at the next check.
+     */
+    static volatile sig_atomic_t stop_requested;
+
+public:
+    /**
+     * This is the default constructor. The file does not need to exist yet.
+     * @param data_file_path The path of the timestamp file to be followed.
+     * @param clock The channel that is going to be used as clock.
+     * @param box_number The number of the box the data come from.
+     * @param chunk_size The maximum number of records that are decoded at once.
+     */
+    TDCpp_follow(const char *data_file_path, uint16_t clock, uint16_t box_number,
+                 uint64_t chunk_size = TDCPP_STREAM_CHUNK_SIZE);
+
+    /**
+     * This is the default destructor.
+     */
+    virtual ~TDCpp_follow();
+
+    /**
+     * Stop all the objects that are following a file, at their next check. It can be called from a signal handler.
+     */
+    static void request_stop() {
+        stop_requested = 1;
+    }
+
+    /**
+     * @brief This method counts n-fold coincidences on the file while it grows.
+     *
+     * The counts are updated with every new chunk, and published every publish_interval seconds to the two
+     * files, which are replaced atomically so that they can be read at any time. The events/s since the previous
+     * publication are printed on the standard output.
+     * It returns when request_stop() is called or when the file did not grow for idle_timeout seconds, after
+     * counting and publishing the remaining events. The final counts are the same as
+     * TDCpp_stream::find_n_fold_coincidences() on the complete file.
+     * @param n The *exact* number of events that must occur at the same time (modulo coincidence_window).
+     * @param singles_file_name The name of the file in which the single events count will be saved.
+     * @param coincidences_file_name The name of the file in which the coincidence events will be saved.
+     * @param coincidence_window The maximum time distance *in bins* in which two
+     *      or more events are considered coincident.
+     * @param publish_interval The time between two publications of the counts, in seconds.
+     * @param idle_timeout The time without new records after which the acquisition is considered over,
+     *      in seconds. Zero means that the file is followed until request_stop() is called.
+     * @param legacyFormat Use and alternative printing standard, for compatibility.
+     */
+    void follow_n_fold_coincidences(uint16_t n,
+                                    const char *singles_file_name,
+                                    const char *coincidences_file_name,
+                                    uint64_t coincidence_window,
+                                    double publish_interval,
+                                    double idle_timeout = 0,
+                                    bool legacyFormat = false);
+
+private:
+    /**
+     * Open the file and start watching it, if it exists.
+     * @return True if the file is open.
+     */
+    bool open_file();
+
+    /**
+     * @return The number of complete records in the file that have not been read yet.
+     */
+    uint64_t get_available_records();
+
+    /**
+     * Read the next records of the file into a new chunk.
+     * @param n_records The number of records to read, at most #chunk_size.
+     * @return The number of events in the chunk.
+     */
+    uint64_t read_chunk(uint64_t n_records);
+
+    /**
+     * Wait until the file changes, or until the timeout expires.
+     * @param timeout The maximum time to wait, in milliseconds.
+     */
+    void wait_for_change(int timeout);
+};
+
+#endif //TDCPP_FOLLOW_H
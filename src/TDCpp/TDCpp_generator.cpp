@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <utility>
+#include "TDCpp_generator.h"
+#include "TDCpp_data.h"
+
+/**
+ * The number of records written to the file at once.
+ */
+#define TDCPP_GENERATOR_WRITE_BLOCK 65536
+
+TDCpp_generator::TDCpp_generator(uint16_t num_boxes, double duration, uint64_t seed) {
+    if (num_boxes == 0) {
+        log_error_and_exit("There must be at least one box.");
+    }
+
+    this->num_boxes = num_boxes;
+    this->duration = duration;
+    this->singles_rate = TDCPP_GENERATOR_SINGLES_RATE;
+    this->clock_rate = TDCPP_GENERATOR_CLOCK_RATE;
+    this->coincidence_n = 0;
+    this->coincidence_rate = 0;
+    this->jitter = 0;
+    this->drift.assign(num_boxes, 0);
+    this->start_delay.assign(num_boxes, 0);
+    this->seed = seed;
+}
+
+void TDCpp_generator::set_singles_rate(double rate) {
+    this->singles_rate = rate;
+}
+
+void TDCpp_generator::set_clock_rate(double rate) {
+    this->clock_rate = rate;
+}
+
+void TDCpp_generator::set_coincidences(uint16_t n, double rate, double jitter) {
+    if (n > this->num_boxes * TDCPP_GENERATOR_SIGNAL_CHANNELS) {
+        log_error_and_exit("There are not enough channels for the correlated events.");
+    }
+
+    this->coincidence_n = n;
+    this->coincidence_rate = rate;
+    this->jitter = jitter;
+}
+
+void TDCpp_generator::set_drift(uint16_t box_index, double drift) {
+    if (box_index >= this->num_boxes) {
+        log_error_and_exit("The box index is out of range.");
+    }
+
+    this->drift[box_index] = drift;
+}
+
+void TDCpp_generator::set_start_delay(uint16_t box_index, double delay) {
+    if (box_index >= this->num_boxes || delay < 0) {
+        log_error_and_exit("The box index or the start delay is out of range.");
+    }
+
+    this->start_delay[box_index] = delay;
+}
+
+uint64_t TDCpp_generator::write_file(uint16_t box_index, const char *data_file_path) const {
+    if (box_index >= this->num_boxes) {
+        log_error_and_exit("The box index is out of range.");
+    }
+
+    const double start = this->start_delay[box_index];
+    const double bins_per_second = TDCPP_ONE_SEC_BINS * (1 + this->drift[box_index]);
+
+    // The timestamp and the stored channel of each event.
+    std::vector<std::pair<uint64_t, uint16_t>> events;
+    events.reserve((uint64_t) (this->duration * (this->singles_rate * TDCPP_GENERATOR_SIGNAL_CHANNELS +
+                                                 this->clock_rate + this->coincidence_rate) * 1.01));
+
+    // The clocks and the correlated events come from the same random numbers for all the boxes.
+    std::mt19937_64 shared_random(this->seed);
+
+    if (this->clock_rate > 0) {
+        std::exponential_distribution<double> clock_interval(this->clock_rate);
+        double time = clock_interval(shared_random);
+        for (; time < this->duration; time += clock_interval(shared_random)) {
+            if (time >= start) {
+                events.push_back(std::make_pair((uint64_t) llround((time - start) * bins_per_second),
+                                                (uint16_t) TDCPP_GENERATOR_SIGNAL_CHANNELS));
+            }
+        }
+    }
+
+    if (this->coincidence_n > 0 && this->coincidence_rate > 0) {
+        std::exponential_distribution<double> group_interval(this->coincidence_rate);
+        std::normal_distribution<double> event_jitter(0, this->jitter);
+        std::vector<uint16_t> joint_channels(this->num_boxes * TDCPP_GENERATOR_SIGNAL_CHANNELS);
+
+        double time = group_interval(shared_random);
+        for (; time < this->duration; time += group_interval(shared_random)) {
+            // Draw n different channels among the ones of all the boxes.
+            for (uint16_t i = 0; i < joint_channels.size(); ++i) {
+                joint_channels[i] = i;
+            }
+            for (uint16_t i = 0; i < this->coincidence_n; ++i) {
+                std::uniform_int_distribution<uint16_t> pick(i, (uint16_t) (joint_channels.size() - 1));
+                std::swap(joint_channels[i], joint_channels[pick(shared_random)]);
+
+                double event_time = time + (this->jitter > 0 ? event_jitter(shared_random) : 0);
+                uint16_t event_box = joint_channels[i] / TDCPP_GENERATOR_SIGNAL_CHANNELS;
+                uint16_t event_channel = joint_channels[i] % TDCPP_GENERATOR_SIGNAL_CHANNELS;
+                if (event_box == box_index && event_time >= start) {
+                    events.push_back(std::make_pair((uint64_t) llround((event_time - start) * bins_per_second),
+                                                    event_channel));
+                }
+            }
+        }
+    }
+
+    // The single events are different for each box.
+    if (this->singles_rate > 0) {
+        std::mt19937_64 box_random(this->seed + 1 + box_index);
+        std::exponential_distribution<double> single_interval(this->singles_rate);
+
+        for (uint16_t c = 0; c < TDCPP_GENERATOR_SIGNAL_CHANNELS; ++c) {
+            double time = single_interval(box_random);
+            for (; time < this->duration; time += single_interval(box_random)) {
+                if (time >= start) {
+                    events.push_back(std::make_pair((uint64_t) llround((time - start) * bins_per_second), c));
+                }
+            }
+        }
+    }
+
+    std::sort(events.begin(), events.end());
+
+    FILE *data_file = fopen(data_file_path, "wb");
+    if (data_file == NULL) {
+        std::string error_string("Can't write to ");
+        error_string.append(data_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    char header[TDCPP_HEADER_SIZE];
+    memset(header, 0, TDCPP_HEADER_SIZE);
+    bool is_written = fwrite(header, 1, TDCPP_HEADER_SIZE, data_file) == TDCPP_HEADER_SIZE;
+
+    // Pack the records as the ID800-TDC does.
+    char *records = (char *) malloc(TDCPP_GENERATOR_WRITE_BLOCK * TDCPP_RECORD_SIZE);
+    if (records == NULL) {
+        fclose(data_file);
+        log_error_and_exit("Could not allocate the memory to write a file.");
+    }
+
+    for (uint64_t first = 0; first < events.size() && is_written; first += TDCPP_GENERATOR_WRITE_BLOCK) {
+        uint64_t block_size = std::min((uint64_t) TDCPP_GENERATOR_WRITE_BLOCK, (uint64_t) events.size() - first);
+        for (uint64_t i = 0; i < block_size; ++i) {
+            memcpy(records + i * TDCPP_RECORD_SIZE, &events[first + i].first, TDCPP_TIMESTAMP_SIZE);
+            memcpy(records + i * TDCPP_RECORD_SIZE + TDCPP_TIMESTAMP_SIZE, &events[first + i].second,
+                   TDCPP_CHANNEL_SIZE);
+        }
+        is_written = fwrite(records, TDCPP_RECORD_SIZE, block_size, data_file) == block_size;
+    }
+
+    free(records);
+
+    if (fclose(data_file) != 0 || !is_written) {
+        std::string error_string("Could not write the file ");
+        error_string.append(data_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    return events.size();
+}
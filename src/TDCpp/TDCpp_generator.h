@@ -0,0 +1,136 @@
+#ifndef TDCPP_GENERATOR_H
+#define TDCPP_GENERATOR_H
+
+#include <stdint-gcc.h>
+#include <vector>
+
+/**
+ * The default rate of the single events on each channel, in Hz.
+ */
+#define TDCPP_GENERATOR_SINGLES_RATE 100000
+
+/**
+ * The default mean rate of the clock events, in Hz.
+ */
+#define TDCPP_GENERATOR_CLOCK_RATE 1000
+
+/**
+ * The number of channels of each box that get single and correlated events. The last one is the clock.
+ */
+#define TDCPP_GENERATOR_SIGNAL_CHANNELS 7
+
+/**
+ * @brief This class writes synthetic timestamp files, in the same format as the ID800-TDC.
+ *
+ * Each box gets Poisson single events on its signal channels and the clock events on its last channel (8).
+ * The clock events are shared by all the boxes, with Poisson intervals so that each stretch of clocks can
+ * be told apart from the others, as the merger needs. The correlated events happen at the same time on n
+ * channels, chosen at random among all the channels of all the boxes, with a Gaussian jitter.
+ *
+ * Each box measures the time with its own drift, and starts acquiring a given time after the first box,
+ * from a timestamp of zero. The same seed always gives the same files.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_generator {
+
+protected:
+    /**
+     * The number of boxes.
+     */
+    uint16_t num_boxes;
+
+    /**
+     * The length of the acquisition, in seconds of the first box.
+     */
+    double duration;
+
+    /**
+     * The rate of the single events on each signal channel, in Hz.
+     */
+    double singles_rate;
+
+    /**
+     * The mean rate of the clock events, in Hz.
+     */
+    double clock_rate;
+
+    /**
+     * The number of events of each correlated group, zero for no correlations.
+     */
+    uint16_t coincidence_n;
+
+    /**
+     * The rate of the correlated groups, in Hz.
+     */
+    double coincidence_rate;
+
+    /**
+     * The standard deviation of the time of each correlated event, in seconds.
+     */
+    double jitter;
+
+    /**
+     * The relative drift of the time of each box, e.g. 1E-6 is one more bin every million.
+     */
+    std::vector<double> drift;
+
+    /**
+     * The time at which each box starts acquiring, in seconds after the first box.
+     */
+    std::vector<double> start_delay;
+
+    /**
+     * The seed of the random numbers.
+     */
+    uint64_t seed;
+
+public:
+    /**
+     * This is the default constructor. There are no correlations, drift or start delays yet.
+     * @param num_boxes The number of boxes.
+     * @param duration The length of the acquisition, in seconds.
+     * @param seed The seed of the random numbers.
+     */
+    TDCpp_generator(uint16_t num_boxes, double duration, uint64_t seed = 1);
+
+    /**
+     * @param rate The rate of the single events on each signal channel, in Hz.
+     */
+    void set_singles_rate(double rate);
+
+    /**
+     * @param rate The mean rate of the clock events, in Hz.
+     */
+    void set_clock_rate(double rate);
+
+    /**
+     * Inject correlated events.
+     * @param n The number of events of each group, on as many different channels.
+     * @param rate The rate of the groups, in Hz.
+     * @param jitter The standard deviation of the time of each event, in seconds.
+     */
+    void set_coincidences(uint16_t n, double rate, double jitter);
+
+    /**
+     * @param box_index The index of the box, from 0.
+     * @param drift The relative drift of the time of the box.
+     */
+    void set_drift(uint16_t box_index, double drift);
+
+    /**
+     * @param box_index The index of the box, from 0.
+     * @param delay The time at which the box starts acquiring, in seconds after the first box.
+     */
+    void set_start_delay(uint16_t box_index, double delay);
+
+    /**
+     * Write the timestamp file of a box.
+     * @param box_index The index of the box, from 0.
+     * @param data_file_path The path of the file.
+     * @return The number of events in the file.
+     */
+    uint64_t write_file(uint16_t box_index, const char *data_file_path) const;
+};
+
+#endif //TDCPP_GENERATOR_H
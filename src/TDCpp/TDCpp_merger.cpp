@@ -1,298 +1,612 @@
-#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "TDCpp_merger.h"
+#include "TDCpp_drift.h"
+#include "TDCpp_metrics.h"
+#include "TDCpp_packed.h"
 
-TDCpp_merger::TDCpp_merger(TDCpp_data *first_data, TDCpp_data *second_data) {
-    this->first_data = first_data;
-    this->second_data = second_data;
-
-    // This is needed to ensure channels are named correctly.
-    this->box_number = 1;
-
-    this->clock = this->first_data->get_clock_channel();
-    this->num_channels = this->first_data->get_channels_number() + this->second_data->get_channels_number();
-
-    // Set the offsets to zero, if needed they are going to be loaded later.
-    this->offset = (int16_t *) calloc(this->num_channels, sizeof(int16_t));
+TDCpp_merger::TDCpp_merger(TDCpp_data *first_data, TDCpp_data *second_data)
+        : TDCpp_merger(std::vector<TDCpp_data *>{first_data, second_data}) {
+}
 
-    // Find the matching index between the two objects. Also find which object is delayed.
-    this->find_match(200, 20);
+TDCpp_merger::TDCpp_merger(const std::vector<TDCpp_data *> &boxes, uint16_t num_threads) {
+    this->match_and_merge(boxes, num_threads, nullptr);
+}
 
-    // Join the two objects into one.
-    this->merge(100);
+TDCpp_merger::TDCpp_merger(const std::vector<TDCpp_data *> &boxes, TDCpp_buffer<uint64_t> &packed_events,
+                           uint16_t num_threads) {
+    this->match_and_merge(boxes, num_threads, &packed_events);
 }
 
 TDCpp_merger::~TDCpp_merger() {
-    this->first_data = nullptr;
-    this->second_data = nullptr;
-
-    free(this->first_clocks);
-    free(this->second_clocks);
-    free(this->offset);
 }
 
-void TDCpp_merger::find_match(uint64_t max_shift, uint64_t time_depth) {
-    // Allocate the arrays that will contains the clock events of the two objects.
-    this->first_clocks = (uint64_t *) malloc(this->first_data->get_size() * sizeof(uint64_t));
-    this->second_clocks = (uint64_t *) malloc(this->second_data->get_size() * sizeof(uint64_t));
+void TDCpp_merger::match_and_merge(const std::vector<TDCpp_data *> &boxes, uint16_t num_threads,
+                                   TDCpp_buffer<uint64_t> *packed_events) {
+    if (boxes.size() < 2) {
+        log_error_and_exit("At least two objects are needed to merge.");
+    }
 
-    // Get the clock events, as well as their count.
-    this->num_first_clocks = this->first_data->get_clock_array(this->first_clocks);
-    this->num_second_clocks = this->second_data->get_clock_array(this->second_clocks);
+    this->boxes = boxes;
 
-    // Allocate the arrays for the time differences between clock events.
-    uint64_t *first_clock_deltas = (uint64_t *) malloc((this->num_first_clocks - 1) * sizeof(uint64_t));
-    uint64_t *second_clock_deltas = (uint64_t *) malloc((this->num_second_clocks - 1) * sizeof(uint64_t));
+    // This is needed to ensure channels are named correctly.
+    this->box_number = 1;
 
-    // Populate the delta arrays
-    for (uint64_t i = 0; i < this->num_first_clocks - 1; ++i) {
-        first_clock_deltas[i] = this->first_clocks[i + 1] - this->first_clocks[i];
+    this->clock = this->boxes[0]->get_clock_channel();
+    this->num_channels = 0;
+    for (auto box : this->boxes) {
+        this->num_channels += box->get_channels_number();
     }
-    for (uint64_t i = 0; i < this->num_second_clocks - 1; ++i) {
-        second_clock_deltas[i] = this->second_clocks[i + 1] - this->second_clocks[i];
+
+    // Set the offsets to zero, if needed they are going to be loaded later.
+    this->offset = this->offset_buffer.allocate_zeroed(this->num_channels);
+
+    // Get the clock events of all the objects, as well as their count, from their clock index.
+    for (auto box : this->boxes) {
+        this->num_box_clocks.push_back(box->get_clock_number());
+        this->box_clocks.push_back(box->get_clock_timestamps());
     }
 
-    // Find what is the maximum possible shift between the objects, given the time depth.
-    if (this->num_first_clocks - time_depth < max_shift) max_shift = this->num_first_clocks - time_depth;
-    if (this->num_second_clocks - time_depth < max_shift) max_shift = this->num_second_clocks - time_depth;
+    // Find the matching clock between each object and the reference.
+    this->reference_matching_clock.assign(this->boxes.size(), 0);
+    this->box_matching_clock.assign(this->boxes.size(), 0);
+    for (uint64_t b = 1; b < this->boxes.size(); ++b) {
+        this->find_match(b, 20);
+    }
 
-    uint64_t distance_forward, distance_backward;
-    // The following variables will be properly initialized in the following loop, this
-    // is only needed for the warnings the compiler raises.
-    uint64_t min_distance_forward = 0, min_distance_forward_position = 0;
-    uint64_t min_distance_backward = 0, min_distance_backward_position = 0;
-    bool min_distance_changed;
+    // Join all the objects into one.
+    this->merge(num_threads, packed_events);
+}
 
-    // Evaluate the time differences.
-    for (uint64_t i = 0; i < max_shift; ++i) {
-        uint64_t i_back = i+1;
+void TDCpp_merger::find_match(uint64_t box_index, uint64_t time_depth) {
+    TDCpp_stage_timer timer("match");
 
-        if (i == max_shift -1 ){
-            i_back = i;
-        }
-        min_distance_changed = false;
-        distance_backward = distance_forward = 0;
-        for (uint64_t j = 0; j < time_depth; ++j) {
-            // Here i is the delay between the objects. j is the time index.
-            distance_forward += abs_diff_64(first_clock_deltas[j], second_clock_deltas[i + j]);
-            distance_backward += abs_diff_64(first_clock_deltas[i_back + j], second_clock_deltas[j]);
-        }
+    const uint64_t *reference_clocks = this->box_clocks[0];
+    const uint64_t *clocks = this->box_clocks[box_index];
+    const uint64_t num_reference_deltas = this->num_box_clocks[0] - 1;
+    const uint64_t num_deltas = this->num_box_clocks[box_index] - 1;
 
-        // Need just on the first step.
-        if (i == 0) {
-            min_distance_forward = distance_forward;
-            min_distance_forward_position = 0;
-            min_distance_backward = distance_backward;
-            min_distance_backward_position = 1;
-            min_distance_changed = true;
-        } else {
-            if (distance_forward < min_distance_forward) {
-                min_distance_forward = distance_forward;
-                min_distance_forward_position = i;
-                min_distance_changed = true;
-            }
+    if (this->num_box_clocks[0] < time_depth + 1 || this->num_box_clocks[box_index] < time_depth + 1) {
+        log_error_and_exit("Not enough clock events to find a match.");
+    }
 
-            if (distance_backward < min_distance_backward) {
-                min_distance_backward = distance_backward;
-                min_distance_backward_position = i_back;
-                min_distance_changed = true;
+    // Sort the time differences between the reference clock events, together with their position.
+    // Looking up the deltas that are close to a given one is then a binary search.
+    std::vector<std::pair<uint64_t, uint64_t>> reference_deltas(num_reference_deltas);
+    for (uint64_t i = 0; i < num_reference_deltas; ++i) {
+        reference_deltas[i] = std::make_pair(reference_clocks[i + 1] - reference_clocks[i], i);
+    }
+    std::sort(reference_deltas.begin(), reference_deltas.end());
+
+    // Every reference delta that is close to a delta of the object votes for the shift between the two.
+    // The shift is the position in the reference minus the position in the object. The right shift collects
+    // one vote per delta, while the wrong ones are spread at random, so we can stop as soon as it stands out.
+    std::unordered_map<int64_t, uint64_t> votes;
+    int64_t best_shift = 0, second_shift = 0;
+    uint64_t best_votes = 0, second_votes = 0;
+    uint64_t j = 0;
+    for (; j < num_deltas && best_votes < second_votes + time_depth; ++j) {
+        uint64_t delta = clocks[j + 1] - clocks[j];
+        uint64_t tolerance = TDCPP_MATCH_TOLERANCE + (uint64_t) ((double) delta * TDCPP_MATCH_MAX_DRIFT);
+        uint64_t lowest = delta > tolerance ? delta - tolerance : 0;
+
+        auto it = std::lower_bound(reference_deltas.begin(), reference_deltas.end(),
+                                   std::make_pair(lowest, (uint64_t) 0));
+        for (; it != reference_deltas.end() && it->first <= delta + tolerance; ++it) {
+            int64_t shift = (int64_t) it->second - (int64_t) j;
+            uint64_t count = ++votes[shift];
+
+            if (shift == best_shift) {
+                best_votes = count;
+            } else if (count > best_votes) {
+                second_shift = best_shift;
+                second_votes = best_votes;
+                best_shift = shift;
+                best_votes = count;
+            } else if (count > second_votes) {
+                second_shift = shift;
+                second_votes = count;
             }
         }
+    }
 
-        if (min_distance_changed) {
-            if (custom_ratio(min_distance_backward, min_distance_forward) >= TDCPP_MATCH_THRESHOLD) i = max_shift;
-        }
+    // Sum the differences between the deltas, from the first common clock event on.
+    auto distance = [&](int64_t shift) {
+        uint64_t reference_start = shift > 0 ? (uint64_t) shift : 0;
+        uint64_t start = shift < 0 ? (uint64_t) -shift : 0;
+        if (reference_start >= num_reference_deltas || start >= num_deltas) return UINT64_MAX;
 
+        uint64_t depth = time_depth;
+        if (num_reference_deltas - reference_start < depth) depth = num_reference_deltas - reference_start;
+        if (num_deltas - start < depth) depth = num_deltas - start;
 
-    }
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < depth; ++i) {
+            sum += abs_diff_64(reference_clocks[reference_start + i + 1] - reference_clocks[reference_start + i],
+                               clocks[start + i + 1] - clocks[start + i]);
+        }
+        return sum;
+    };
 
-    if (min_distance_forward < min_distance_backward) {
-        this->matching_clock = min_distance_forward_position + 1;
-        this->box_to_match = 2;
+    // Confront the best shift with the runner-up, or with a neighbour that is in range if nothing else got a vote.
+    // Without anything to compare with, the match can't be trusted.
+    uint64_t best_distance = distance(best_shift);
+    uint64_t second_distance = UINT64_MAX;
+    if (second_votes > 0) {
+        second_distance = distance(second_shift);
     } else {
-        this->matching_clock = min_distance_backward_position + 1;
-        this->box_to_match = 1;
+        second_shift = best_shift + 1;
+        second_distance = distance(second_shift);
+        if (second_distance == UINT64_MAX) {
+            second_shift = best_shift - 1;
+            second_distance = distance(second_shift);
+        }
+    }
+    uint64_t quality = 0;
+    if (best_distance != UINT64_MAX && second_distance != UINT64_MAX) {
+        quality = second_distance / (best_distance > 0 ? best_distance : 1);
     }
 
+    const std::string value_prefix = "box_" + std::to_string(box_index + 1) + "_match_";
+    TDCpp_metrics::set_value(value_prefix + "best_distance", (double) best_distance);
+    TDCpp_metrics::set_value(value_prefix + "runner_up_distance", (double) second_distance);
+    TDCpp_metrics::set_value(value_prefix + "quality", (double) quality);
+
     // Check if the match is good
-    if ((custom_ratio(min_distance_backward, min_distance_forward) < TDCPP_MATCH_THRESHOLD)) {
+    if (best_votes == 0 || quality < TDCPP_MATCH_THRESHOLD) {
         char error_str[256];
         sprintf(error_str,
-                "Failed to find a match. Forward: %" PRIu64 ". Backward: %" PRIu64 ".",
-                min_distance_forward, min_distance_backward);
+                "Failed to find a match. Best: %" PRIu64 ". Runner-up: %" PRIu64 ".",
+                best_distance, second_distance);
         log_error_and_exit(error_str);
     }
 
+    // The clock of one of the two objects is matched with the first clock of the other one.
+    if (best_shift >= 0) {
+        this->reference_matching_clock[box_index] = (uint64_t) best_shift;
+        this->box_matching_clock[box_index] = 0;
+    } else {
+        this->reference_matching_clock[box_index] = 0;
+        this->box_matching_clock[box_index] = (uint64_t) -best_shift;
+    }
 
-
-    free(first_clock_deltas);
-    free(second_clock_deltas);
+    // The clock deltas of the object that were looked up.
+    timer.stop(j);
+    TDCpp_metrics::set_value(value_prefix + "reference_clock", (double) this->reference_matching_clock[box_index]);
+    TDCpp_metrics::set_value(value_prefix + "box_clock", (double) this->box_matching_clock[box_index]);
 }
 
-void TDCpp_merger::merge(uint64_t max_fit_points) {
-    uint64_t starting_index_first, starting_index_second;
-    uint64_t matching_clock_first, matching_clock_second;
-
-    // Find the index of the first common clock in the two objects (actually is the second, since find_match
-    // returns the second one)
-    if (this->box_to_match == 1) {
-        starting_index_first = this->first_data->find_nth_clock(this->matching_clock);
-        matching_clock_first = this->matching_clock;
-        starting_index_second = this->second_data->find_nth_clock(1);
-        matching_clock_second = 1;
-    } else {
-        starting_index_first = this->first_data->find_nth_clock(1);
-        matching_clock_first = 1;
-        starting_index_second = this->second_data->find_nth_clock(this->matching_clock);
-        matching_clock_second = this->matching_clock;
+void TDCpp_merger::merge(uint16_t num_threads, TDCpp_buffer<uint64_t> *packed_events) {
+    if (num_threads == 0) num_threads = 1;
+    TDCpp_stage_timer fit_timer("drift_fit");
+    const uint64_t num_boxes = this->boxes.size();
+
+    // All the objects start at the latest of the matched clocks, in the time of the reference.
+    // The events before the starting clock are not going to be considered or shifted.
+    std::vector<uint64_t> starting_clock(num_boxes, 0);
+    for (uint64_t b = 1; b < num_boxes; ++b) {
+        if (this->reference_matching_clock[b] > starting_clock[0]) starting_clock[0] = this->reference_matching_clock[b];
+    }
+    for (uint64_t b = 1; b < num_boxes; ++b) {
+        starting_clock[b] = this->box_matching_clock[b] + starting_clock[0] - this->reference_matching_clock[b];
+        if (starting_clock[b] >= this->num_box_clocks[b]) {
+            log_error_and_exit("Not enough clock events to merge the objects.");
+        }
+    }
+
+    // Find the index and the timestamp of the starting clock in each object.
+    std::vector<uint64_t> starting_index(num_boxes), starting_timestamp(num_boxes);
+    for (uint64_t b = 0; b < num_boxes; ++b) {
+        starting_index[b] = this->boxes[b]->find_nth_clock(starting_clock[b] + 1);
+        starting_timestamp[b] = this->boxes[b]->get_timestamp(starting_index[b]);
     }
 
-    // Shift the clock arrays so that the matching event on both is at time zero.
-    // The events before the matching one are not going to be considered or shifted.
-    uint64_t number_matching_clock_first = this->num_first_clocks - matching_clock_first;
-    uint64_t number_matching_clock_second = this->num_second_clocks - matching_clock_second;
+    // Pair the clocks of each object with the ones of the reference, to correct the drift piece by piece.
+    // Within a segment, the time of the object runs (1 + correction) slower than the one of the reference.
+    // After the last common clock the last correction is used.
+    std::vector<std::vector<uint64_t>> box_knots(num_boxes), reference_knots(num_boxes);
+    std::vector<std::vector<int64_t>> corrections(num_boxes);
+    uint64_t num_knots = 0;
+    for (uint64_t b = 1; b < num_boxes; ++b) {
+        this->match_clocks(b, starting_clock[0], starting_clock[b], box_knots[b], reference_knots[b]);
+
+        corrections[b].assign(box_knots[b].size(), 0);
+        for (uint64_t k = 0; k + 1 < box_knots[b].size(); ++k) {
+            corrections[b][k] = drift_correction_fixed_point(box_knots[b][k + 1] - box_knots[b][k],
+                                                             reference_knots[b][k + 1] - reference_knots[b][k]);
+        }
+        if (box_knots[b].size() > 1) corrections[b].back() = corrections[b][box_knots[b].size() - 2];
+
+        // The knots of the object are needed in its own time, like its timestamps.
+        for (auto &knot : box_knots[b]) knot += starting_timestamp[b];
 
-    uint64_t starting_clock_first = this->first_clocks[matching_clock_first];
-    for (uint64_t i = 0; i < number_matching_clock_first; ++i) {
-        this->first_clocks[i + matching_clock_first] -= starting_clock_first;
+        TDCpp_metrics::set_value("box_" + std::to_string(b + 1) + "_clock_pairs", (double) box_knots[b].size());
+        num_knots += box_knots[b].size();
     }
 
-    uint64_t starting_clock_second = this->second_clocks[matching_clock_second];
-    for (uint64_t i = 0; i < number_matching_clock_second; ++i) {
-        this->second_clocks[i + matching_clock_second] -= starting_clock_second;
+    // The paired clocks are the events of the fit.
+    fit_timer.stop(num_knots);
+    TDCpp_stage_timer merge_timer("merge");
+
+    // Describe where each object starts, and how to bring its events to the joint numbering and time.
+    // The channels are shifted as in TDCpp_data::get_channel(), the shift is the same for all the events.
+    std::vector<merge_source> sources(num_boxes);
+    for (uint64_t b = 0; b < num_boxes; ++b) {
+        const TDCpp_data *box = this->boxes[b];
+        merge_source &source = sources[b];
+        source.timestamp = box->get_timestamp_array();
+        source.channel = box->get_channel_array();
+        source.begin = starting_index[b];
+        source.end = box->get_size();
+        source.channel_shift = (uint16_t) (box->get_channel(starting_index[b]) - 1 - source.channel[starting_index[b]]);
+        source.clock = (uint16_t) (box->get_clock_channel() - 1);
+        source.origin = b == 0 ? starting_timestamp[0] : 0;
+        source.knots = box_knots[b].data();
+        source.reference_knots = reference_knots[b].data();
+        source.corrections = corrections[b].data();
+        source.num_knots = b == 0 ? 0 : box_knots[b].size();
     }
 
-    // Find the common number of matched clock events, i.e. the minimum of the two.
-    uint64_t common_number_clocks;
-    if (number_matching_clock_first > number_matching_clock_second) {
-        common_number_clocks = number_matching_clock_second;
+    // Only the clocks of the reference are kept, so the joint size is known in advance.
+    this->size = this->boxes[0]->get_size() - starting_index[0];
+    for (uint64_t b = 1; b < num_boxes; ++b) {
+        this->size += this->boxes[b]->get_size() - starting_index[b] - (this->num_box_clocks[b] - starting_clock[b]);
+    }
+
+    // Split the joint time in parts with about the same number of events, one per thread.
+    // Each part is merged on its own, into its own range of the joint arrays.
+    uint64_t num_parts = num_threads;
+    if (this->size / TDCPP_MERGE_MIN_PART_SIZE < num_parts) num_parts = this->size / TDCPP_MERGE_MIN_PART_SIZE;
+    if (num_parts == 0) num_parts = 1;
+
+    // The pages are first touched by as many threads as there are parts, so they are placed next to the thread
+    // that merges them, see TDCpp_buffer::allocate().
+    uint64_t *joint_events = nullptr;
+    if (packed_events != nullptr) {
+        // The sources are sorted in the joint time, so their last events are the latest ones.
+        if (this->num_channels > TDCPP_PACKED_MAX_CHANNELS) {
+            log_error_and_exit("Too many channels to pack the events.");
+        }
+        for (const merge_source &source : sources) {
+            if (source.end > source.begin && this->joint_time(source, source.end - 1) > TDCPP_PACKED_MAX_TIMESTAMP) {
+                log_error_and_exit("The timestamps are too big to pack the events.");
+            }
+        }
+
+        joint_events = packed_events->allocate(this->size, (uint16_t) num_parts);
+        if (joint_events == nullptr) {
+            log_error_and_exit("Could not allocate the memory for the events.");
+        }
     } else {
-        common_number_clocks = number_matching_clock_first;
+        this->allocate_events(this->size, (uint16_t) num_parts);
     }
 
-    // If there are more common clock events than #max_fit_points, use the latter to fit. Otherwise use the first.
-    if (common_number_clocks > max_fit_points) common_number_clocks = max_fit_points;
-
-    // Perform a linear regression, without intercept.
-    // We will be using the power series 1/(1-x) ~ 1 + x + O(x^2) to correct the derive, since x
-    // is expected to be O(1E-6) or less.
-    double x_times_y = 0., x_squared = 0.;
-    for (uint64_t i = 1; i < common_number_clocks; ++i) {
-        x_times_y +=
-                (double) this->first_clocks[matching_clock_first + i] * this->second_clocks[matching_clock_second + i];
-        x_squared +=
-                (double) this->first_clocks[matching_clock_first + i] * this->first_clocks[matching_clock_first + i];
+    std::vector<std::vector<merge_source>> parts(num_parts, sources);
+    for (uint64_t p = 1; p < num_parts; ++p) {
+        std::vector<uint64_t> split = this->split_sources(sources, p * this->size / num_parts);
+        for (uint64_t b = 0; b < num_boxes; ++b) {
+            parts[p - 1][b].end = split[b];
+            parts[p][b].begin = split[b];
+        }
     }
-    double correction_factor =  1. - x_times_y / x_squared;
 
-    // Allocate space for the matched arrays
-    uint64_t *matched_first_timestamps =
-            (uint64_t *) malloc((this->first_data->get_size() - starting_index_first) * sizeof(uint64_t));
-    uint64_t *matched_second_timestamps =
-            (uint64_t *) malloc((this->second_data->get_size() - starting_index_second) * sizeof(uint64_t));
+    // Count the events of each part, without the clocks of the other objects, to know where to write it.
+    std::vector<uint64_t> part_size(num_parts, 0), part_start(num_parts, 0);
+    for (uint64_t p = 0; p < num_parts; ++p) {
+        for (uint64_t b = 0; b < num_boxes; ++b) {
+            const merge_source &source = parts[p][b];
+            part_size[p] += source.end - source.begin;
+            if (b > 0) part_size[p] -= this->boxes[b]->count_clocks(source.begin, source.end);
+        }
+    }
 
+    for (uint64_t p = 1; p < num_parts; ++p) {
+        part_start[p] = part_start[p - 1] + part_size[p - 1];
+    }
+    if (part_start[num_parts - 1] + part_size[num_parts - 1] != this->size) {
+        log_error_and_exit("The parts of the merge do not add up.");
+    }
+
+    // The threads left over when there are few parts fill the blocks of the other objects, see merge_sources().
+    const uint16_t num_helpers = (uint16_t) (num_threads / num_parts - 1);
+    auto merge_part = [&](uint64_t p) {
+        uint64_t merged = joint_events != nullptr
+                          ? this->merge_sources(parts[p], nullptr, nullptr, joint_events + part_start[p], num_helpers)
+                          : this->merge_sources(parts[p], this->timestamp + part_start[p],
+                                                this->channel + part_start[p], nullptr, num_helpers);
+        if (merged != part_size[p]) log_error_and_exit("The parts of the merge do not add up.");
+    };
+
+    run_tasks(num_parts, merge_part);
+
+    merge_timer.stop(this->size);
+
+    // The packed events belong to the caller.
+    if (packed_events != nullptr) this->size = 0;
+}
+
+uint64_t TDCpp_merger::joint_time(const merge_source &source, uint64_t index) const {
+    if (source.num_knots == 0) return source.timestamp[index] - source.origin;
+
+    uint64_t corrected;
+    correct_drift_segments(source.timestamp + index, 1, &corrected, source.knots, source.reference_knots,
+                           source.corrections, source.num_knots);
+    return corrected - source.origin;
+}
+
+std::vector<uint64_t> TDCpp_merger::split_sources(const std::vector<merge_source> &sources, uint64_t target) const {
+    const uint64_t num_sources = sources.size();
+
+    // The first event of each object that comes at or after the time t. All the events before it come before t,
+    // since the corrected timestamps are sorted.
+    auto split_at = [&](uint64_t t, std::vector<uint64_t> &split) {
+        uint64_t count = 0;
+        for (uint64_t b = 0; b < num_sources; ++b) {
+            uint64_t low = sources[b].begin, high = sources[b].end;
+            while (low < high) {
+                uint64_t middle = low + (high - low) / 2;
+                if (this->joint_time(sources[b], middle) < t) low = middle + 1; else high = middle;
+            }
+            split[b] = low;
+            count += low - sources[b].begin;
+        }
+        return count;
+    };
 
-    // Shift the timestamps of the first (before we shifted only the clock)
-    for (uint64_t i = 0; i < this->first_data->get_size() - starting_index_first; ++i) {
-        matched_first_timestamps[i] =
-                this->first_data->get_timestamp(i + starting_index_first) -
-                this->first_data->get_timestamp(starting_index_first);
+    // Find the earliest time that has at least target events before it, clocks included.
+    uint64_t low = 0, high = 0;
+    for (uint64_t b = 0; b < num_sources; ++b) {
+        if (sources[b].end > sources[b].begin) {
+            uint64_t last = this->joint_time(sources[b], sources[b].end - 1) + 1;
+            if (last > high) high = last;
+        }
     }
 
-/*    this->first_data->copy_timestamp_array(matched_first_timestamps,
-                                           starting_index_first, this->first_data->get_size() - starting_index_first);
+    std::vector<uint64_t> split(num_sources);
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (split_at(middle, split) < target) low = middle + 1; else high = middle;
+    }
+    split_at(low, split);
+    return split;
+}
 
-    uint64_t foo = this->first_data->get_timestamp(starting_index_first);
+uint64_t TDCpp_merger::merge_sources(const std::vector<merge_source> &sources,
+                                     uint64_t *joint_timestamp, uint16_t *joint_channel, uint64_t *joint_events,
+                                     uint16_t num_helpers) {
+    const uint64_t num_sources = sources.size();
+    if (num_helpers > num_sources - 1) num_helpers = (uint16_t) (num_sources - 1);
+
+    // The events that are ready to be merged, for each object. The reference is read straight from its arrays,
+    // the other objects are read one block at a time, without their clocks and with the drift already corrected.
+    struct merge_cursor {
+        const uint64_t *timestamp;
+        const uint16_t *channel;
+        uint64_t position;
+        uint64_t count;
+        uint64_t next;
+    };
+    std::vector<merge_cursor> cursors(num_sources);
+
+    // The blocks of the objects but the reference. With helpers, each object has a ring of blocks that are filled
+    // ahead of the merge, otherwise a single block that is filled when it is needed.
+    // Each block has one extra element, for the clock that may be written last.
+    const uint64_t num_slots = num_helpers > 0 ? TDCPP_MERGE_QUEUE_DEPTH : 1;
+    const uint64_t slot_size = TDCPP_MERGE_BLOCK_SIZE + 1;
+    std::vector<uint64_t> block_timestamp((num_sources - 1) * num_slots * slot_size);
+    std::vector<uint16_t> block_channel((num_sources - 1) * num_slots * slot_size);
+    std::vector<uint64_t> block_count((num_sources - 1) * num_slots);
+
+    // Copy the next events of an object, from next, in one of its slots, dropping the clocks and correcting the
+    // drift. Return the number of events in the block, zero if there are none left.
+    auto fill_block = [&](uint64_t b, uint64_t slot, uint64_t &next) {
+        const merge_source &source = sources[b];
+        const uint64_t block = (b - 1) * num_slots + slot;
+        uint64_t *timestamps = block_timestamp.data() + block * slot_size;
+        uint16_t *channels = block_channel.data() + block * slot_size;
+
+        // Drop the clocks without branching: the write position only moves past non-clocks.
+        uint64_t count = 0, i = next;
+        while (count == 0 && i < source.end) {
+            for (; i < source.end && count < TDCPP_MERGE_BLOCK_SIZE; ++i) {
+                timestamps[count] = source.timestamp[i];
+                channels[count] = source.channel[i];
+                count += source.channel[i] != source.clock;
+            }
+        }
+        next = i;
 
-    auto shift_func = [&] (uint64_t ts) {
-        return ts - foo;
+        correct_drift_segments(timestamps, count, timestamps, source.knots, source.reference_knots,
+                               source.corrections, source.num_knots);
+        block_count[block] = count;
+        return count;
     };
 
-    u64_vectorize_function(matched_first_timestamps, (this->first_data->get_size() - starting_index_first),  shift_func);*/
+    // The blocks of an object are filled in order, and a slot is filled again only once the merge released it.
+    // The merge reads the block after the last released one.
+    struct block_ring {
+        uint64_t filled;
+        uint64_t released;
+        bool finished;
+    };
+    std::vector<block_ring> rings(num_sources, block_ring{0, 0, false});
+    std::mutex ring_mutex;
+    std::condition_variable block_filled, slot_released;
+
+    // Each helper fills the blocks of every num_helpers-th object, whichever has a free slot.
+    auto help = [&](uint64_t h) {
+        std::vector<uint64_t> next(num_sources);
+        for (uint64_t b = 1 + h; b < num_sources; b += num_helpers) next[b] = sources[b].begin;
+
+        std::unique_lock<std::mutex> lock(ring_mutex);
+        while (true) {
+            bool has_work = false, has_filled = false;
+            for (uint64_t b = 1 + h; b < num_sources; b += num_helpers) {
+                block_ring &ring = rings[b];
+                if (ring.finished) continue;
+                has_work = true;
+                if (ring.filled - ring.released == num_slots) continue;
+
+                // The merge does not read the slot until it is marked as filled.
+                const uint64_t slot = ring.filled % num_slots;
+                lock.unlock();
+                uint64_t count = fill_block(b, slot, next[b]);
+                lock.lock();
+                if (count > 0) ring.filled++; else ring.finished = true;
+                has_filled = true;
+            }
+            if (has_filled) block_filled.notify_all();
+            if (!has_work) return;
+            if (!has_filled) slot_released.wait(lock);
+        }
+    };
 
+    // Load the next events of an object in its cursor. Return false if there are none left.
+    auto refill = [&](uint64_t b) {
+        const merge_source &source = sources[b];
+        merge_cursor &cursor = cursors[b];
+        cursor.position = 0;
+
+        if (b == 0) {
+            cursor.timestamp = source.timestamp + cursor.next;
+            cursor.channel = source.channel + cursor.next;
+            cursor.count = source.end - cursor.next;
+            cursor.next = source.end;
+            return cursor.count > 0;
+        }
 
-    // Shift the timestamps of the second and correct for the time drift.
-    for (uint64_t i = 0; i < this->second_data->get_size() - starting_index_second; ++i) {
-        matched_second_timestamps[i] =
-                this->second_data->get_timestamp(i + starting_index_second) -
-                this->second_data->get_timestamp(starting_index_second);
-        matched_second_timestamps[i] += (uint64_t) trunc((double) matched_second_timestamps[i] * correction_factor);
-    }
+        uint64_t slot = 0;
+        if (num_helpers == 0) {
+            if (fill_block(b, slot, cursor.next) == 0) return false;
+        } else {
+            std::unique_lock<std::mutex> lock(ring_mutex);
+            block_ring &ring = rings[b];
+            // The block in the cursor, if any, has been merged.
+            if (cursor.count > 0) {
+                ring.released++;
+                slot_released.notify_all();
+            }
+            block_filled.wait(lock, [&ring] { return ring.filled > ring.released || ring.finished; });
+            if (ring.filled == ring.released) return false;
+            slot = ring.released % num_slots;
+        }
 
-/*    this->second_data->copy_timestamp_array(matched_second_timestamps,
-                                            starting_index_second, this->second_data->get_size() - starting_index_second);
+        const uint64_t block = (b - 1) * num_slots + slot;
+        cursor.timestamp = block_timestamp.data() + block * slot_size;
+        cursor.channel = block_channel.data() + block * slot_size;
+        cursor.count = block_count[block];
+        return true;
+    };
 
-    foo = this->second_data->get_timestamp(starting_index_second);
+    std::vector<std::thread> helpers;
+    for (uint64_t h = 0; h < num_helpers; ++h) {
+        helpers.push_back(std::thread(help, h));
+    }
 
-    auto shift_and_drift_func = [&] (uint64_t ts){
-        ts = ts - foo;
-        return  ts + (uint64_t) trunc((double) ts * correction_factor);
+    // The next event of each object, in the joint time.
+    struct box_head {
+        uint64_t timestamp;
+        uint64_t box;
+    };
+    auto head_of = [&](uint64_t b) {
+        const merge_cursor &cursor = cursors[b];
+        return box_head{cursor.timestamp[cursor.position] - sources[b].origin, b};
     };
 
-    u64_vectorize_function(matched_second_timestamps,
-                           (this->second_data->get_size() - starting_index_second), shift_and_drift_func);*/
-
-    this->size = this->first_data->get_size() + this->second_data->get_size()
-                 - starting_index_first - starting_index_second - number_matching_clock_second;
-    this->timestamp = (uint64_t *) malloc(this->size * sizeof(uint64_t));
-    this->channel = (uint16_t *) malloc(this->size * sizeof(uint16_t));
-
-    uint64_t joint_index = 0, first_index = 0, second_index = 0;
-    bool end_reached = false;
-
-    // Merge and sort the two arrays at the same time. Much faster than merging and then sorting. This in O(n).
-    do {
-        // While we have events in the first array
-        if (first_index < this->first_data->get_size() - starting_index_first) {
-            // While we have events in the second array
-            if (second_index < this->second_data->get_size() - starting_index_second) {
-                // If the event is a clock one, skip it. We are going to keep only the clock events of the first one.
-                while (this->second_data->is_clock(second_index + starting_index_second)) {
-                    second_index++;
-                }
+    // Order of the heap: the lesser timestamp first, and for the same timestamp the last object first.
+    auto comes_after = [](const box_head &a, const box_head &b) {
+        if (a.timestamp != b.timestamp) return a.timestamp > b.timestamp;
+        return a.box < b.box;
+    };
 
-                // Add the lesser of the two timestamps.
-                if (matched_first_timestamps[first_index] < matched_second_timestamps[second_index]) {
-                    this->timestamp[joint_index] = matched_first_timestamps[first_index];
-                    // We need to make this casting, otherwise the compiler complains.
-                    this->channel[joint_index] = (uint16_t)
-                            (this->first_data->get_channel(first_index + starting_index_first) - 1);
-                    first_index++;
+    std::vector<box_head> heap;
+    for (uint64_t b = 0; b < num_sources; ++b) {
+        cursors[b].next = sources[b].begin;
+        if (refill(b)) heap.push_back(head_of(b));
+    }
+    std::make_heap(heap.begin(), heap.end(), comes_after);
+
+    // Merge and sort all the arrays at the same time, in O(n log k). Once an object is on top of the heap,
+    // all its events that come before the runner-up are copied at once.
+    uint64_t joint_index = 0;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), comes_after);
+        const uint64_t b = heap.back().box;
+        const bool has_runner_up = heap.size() > 1;
+        const box_head runner_up = heap.front();
+
+        const merge_source &source = sources[b];
+        merge_cursor &cursor = cursors[b];
+        bool has_events = true;
+        while (true) {
+            for (; cursor.position < cursor.count; ++cursor.position) {
+                uint64_t joint_time = cursor.timestamp[cursor.position] - source.origin;
+                if (has_runner_up && comes_after(box_head{joint_time, b}, runner_up)) break;
+                uint16_t joint_channel_number = cursor.channel[cursor.position] + source.channel_shift;
+                if (joint_events != nullptr) {
+                    joint_events[joint_index] = pack_event(joint_time, joint_channel_number);
                 } else {
-                    this->timestamp[joint_index] = matched_second_timestamps[second_index];
-                    this->channel[joint_index] = (uint16_t)
-                            (this->second_data->get_channel(second_index + starting_index_second) - 1);
-                    second_index++;
+                    joint_timestamp[joint_index] = joint_time;
+                    joint_channel[joint_index] = joint_channel_number;
                 }
-
                 joint_index++;
-            } else {
-                // Copy from the first array, the second is finished.
-                this->timestamp[joint_index] = matched_first_timestamps[first_index];
-                this->channel[joint_index] = (uint16_t)
-                        (this->first_data->get_channel(first_index + starting_index_first) - 1);
-                first_index++;
             }
-        } else {
-            // Copy from the second array, if is not a clock one. The first array is finished.
-            if (second_index < this->second_data->get_size() - starting_index_second) {
-                while (this->second_data->is_clock(second_index + starting_index_second)) {
-                    second_index++;
-                }
-
-                this->timestamp[joint_index] = matched_second_timestamps[second_index];
-                this->channel[joint_index] = (uint16_t)
-                        (this->second_data->get_channel(second_index + starting_index_second) - 1);
-                second_index++;
-                joint_index++;
-            } else {
-                end_reached = true;
+            if (cursor.position < cursor.count) break;
+            if (!refill(b)) {
+                has_events = false;
+                break;
             }
         }
-    } while ((joint_index < this->size) && (this->timestamp[joint_index - 1] < TDCPP_ONE_SEC_BINS) && not end_reached);
 
-    // This is the actual size of the joint array.
-    this->size = joint_index;
+        if (has_events) {
+            heap.back() = head_of(b);
+            std::push_heap(heap.begin(), heap.end(), comes_after);
+        } else {
+            heap.pop_back();
+        }
+    }
+
+    for (auto &helper : helpers) {
+        helper.join();
+    }
+
+    return joint_index;
+}
+
+void TDCpp_merger::match_clocks(uint64_t box_index, uint64_t reference_start, uint64_t box_start,
+                                std::vector<uint64_t> &box_knots, std::vector<uint64_t> &reference_knots) {
+    const uint64_t *reference_clocks = this->box_clocks[0];
+    const uint64_t *clocks = this->box_clocks[box_index];
+    const uint64_t num_reference_clocks = this->num_box_clocks[0];
+    const uint64_t num_clocks = this->num_box_clocks[box_index];
+
+    box_knots.clear();
+    reference_knots.clear();
+
+    // Walk along both clocks at the same time. If one of the objects missed a clock event, or recorded a spurious
+    // one, the deltas stop matching: skip the event that makes the shorter delta and try again.
+    uint64_t i = reference_start, j = box_start;
+    uint64_t skipped = 0;
+    while (i < num_reference_clocks && j < num_clocks) {
+        box_knots.push_back(clocks[j] - clocks[box_start]);
+        reference_knots.push_back(reference_clocks[i] - reference_clocks[reference_start]);
+
+        uint64_t next_i = i + 1, next_j = j + 1;
+        while (next_i < num_reference_clocks && next_j < num_clocks) {
+            uint64_t reference_delta = reference_clocks[next_i] - reference_clocks[i];
+            uint64_t delta = clocks[next_j] - clocks[j];
+            uint64_t tolerance = TDCPP_MATCH_TOLERANCE + (uint64_t) ((double) delta * TDCPP_MATCH_MAX_DRIFT);
+
+            if (abs_diff_64(reference_delta, delta) <= tolerance) break;
+            if (reference_delta < delta) next_i++; else next_j++;
+            skipped++;
+        }
+        i = next_i;
+        j = next_j;
+    }
 
-    free(matched_first_timestamps);
-    free(matched_second_timestamps);
+    TDCpp_metrics::set_value("box_" + std::to_string(box_index + 1) + "_skipped_clocks", (double) skipped);
 }
@@ -3,17 +3,44 @@
 
 #include "TDCpp_data.h"
 #include <cmath>
+#include <vector>
 
 /**
  * A threshold to accept or reject the matching of two TDCpp_data objects.
- * This is the ratio between the cumulative sums of time_deltas.
+ * This is the ratio between the cumulative sums of time_deltas, for the runner-up and the best alignment.
  */
 #define TDCPP_MATCH_THRESHOLD 1000
 
 /**
- * \brief This class is used to merge two TDCpp_data objects into one.
+ * The difference, in bins, under which two clock deltas are considered the same, regardless of the drift.
+ */
+#define TDCPP_MATCH_TOLERANCE 16
+
+/**
+ * The maximum relative drift between the clocks of two objects, used to widen #TDCPP_MATCH_TOLERANCE.
+ */
+#define TDCPP_MATCH_MAX_DRIFT 1E-5
+
+/**
+ * The number of events of each object that are filtered and corrected at once while merging.
+ */
+#define TDCPP_MERGE_BLOCK_SIZE 4096
+
+/**
+ * The number of blocks of each object that can be filled ahead of the merge.
+ */
+#define TDCPP_MERGE_QUEUE_DEPTH 4
+
+/**
+ * The minimum number of events each thread merges. Smaller merges are split among fewer threads.
+ */
+#define TDCPP_MERGE_MIN_PART_SIZE 65536
+
+/**
+ * \brief This class is used to merge two or more TDCpp_data objects into one.
  *
- * It uses a clock channel to match the two objects, and corrects the time derive with a linear fit.
+ * It uses a clock channel to match each object to the first one (the reference), and corrects the time derive
+ * piecewise linearly between the clock events. All the objects are then joined in a single pass, with a k-way merge.
  *
  * @author Matteo Pompili (matpompili at gmail com)
  *
@@ -22,44 +49,51 @@
 class TDCpp_merger : public TDCpp_data {
 protected:
     /**
-     * A pointer to the first of the two objects that are going to be merged.
+     * The objects that are going to be merged. The first one is the reference for the time.
      */
-    TDCpp_data *first_data;
+    std::vector<TDCpp_data *> boxes;
 
     /**
-     * A pointer to the second of the two objects that are going to be merged.
+     * The clock arrays of each object, from their clock index.
      */
-    TDCpp_data *second_data;
+    std::vector<const uint64_t *> box_clocks;
 
     /**
-     * A pointer to the clock array of the first object.
+     * The number of clocks in each object, i.e. the size of each array in #box_clocks.
      */
-    uint64_t *first_clocks;
+    std::vector<uint64_t> num_box_clocks;
 
     /**
-     * A pointer to the clock array of the second object.
+     * For each object, the index of the reference clock that matches #box_matching_clock.
+     * The first element, i.e. the reference itself, is not used.
      */
-    uint64_t *second_clocks;
+    std::vector<uint64_t> reference_matching_clock;
 
     /**
-     * The number of clocks in the first object, i.e. the size of #first_clocks
+     * For each object, the index of its own clock that matches #reference_matching_clock.
      */
-    uint64_t num_first_clocks;
+    std::vector<uint64_t> box_matching_clock;
 
     /**
-     * The number of clocks in the second object, i.e. the size of #second_clocks
+     * The events of an object that are going to be merged, with what is needed to bring them to the joint
+     * numbering and time.
      */
-    uint64_t num_second_clocks;
-
-    /**
-     * Either 1 or 2. If it is 1, then #matching_clock refers to the first box. Otherwise it refers to the second box.
-     */
-    uint8_t box_to_match;
-
-    /**
-     * The index of the first common clock. It refers to box number #box_to_match.
-     */
-    uint64_t matching_clock;
+    struct merge_source {
+        const uint64_t *timestamp;
+        const uint16_t *channel;
+        /** The range of events to merge. */
+        uint64_t begin, end;
+        /** Added to the stored channel to get the joint one. */
+        uint16_t channel_shift;
+        /** The stored channel of the clock, dropped from all the objects but the reference. */
+        uint16_t clock;
+        /** Subtracted from the corrected timestamps to get the joint ones. */
+        uint64_t origin;
+        /** The piecewise drift model, see correct_drift_segments(). There are no knots for the reference. */
+        const uint64_t *knots, *reference_knots;
+        const int64_t *corrections;
+        uint64_t num_knots;
+    };
 
 public:
     /**
@@ -69,25 +103,110 @@ public:
      */
     TDCpp_merger(TDCpp_data *first_data, TDCpp_data *second_data);
 
+    /**
+     * This is an additional constructor, to merge any number of objects at once.
+     * Each object is matched to the first one, and the joint stream is produced in one pass.
+     * The channels of each object are numbered as in TDCpp_data::get_channel().
+     * @param boxes The TDCpp_data objects that are going to be merged, at least two.
+     * @param num_threads The number of threads used to merge the objects. The result does not depend on it.
+     */
+    explicit TDCpp_merger(const std::vector<TDCpp_data *> &boxes, uint16_t num_threads = 1);
+
     /**
      * This is the default destructor.
      */
     virtual ~TDCpp_merger();
 
+protected:
+    /**
+     * This is an additional constructor, to merge the objects straight into packed events, see TDCpp_packed.
+     * The object keeps the channels and the clock of the joint stream, but no events.
+     * @param boxes The TDCpp_data objects that are going to be merged, at least two.
+     * @param packed_events The buffer that receives the joint events, packed.
+     * @param num_threads The number of threads used to merge the objects.
+     */
+    TDCpp_merger(const std::vector<TDCpp_data *> &boxes, TDCpp_buffer<uint64_t> &packed_events,
+                 uint16_t num_threads);
+
+    friend class TDCpp_packed;
+
 private:
     /**
-     * Find the first common clock event in the two TDCpp_data objects.
-     * @param max_shift Max offset to consider.
-     * This depend on both the rate of the clock and the starting delay of the boxes.
-     * @param time_depth Size of the timestamps subarrays to confront.
+     * Match each object to the reference and join them, see merge(). It is called by the constructors.
+     * @param boxes The TDCpp_data objects that are going to be merged, at least two.
+     * @param num_threads The number of threads used to merge the objects.
+     * @param packed_events If not null, the joint events are packed in it instead of the arrays of the object.
+     */
+    void match_and_merge(const std::vector<TDCpp_data *> &boxes, uint16_t num_threads,
+                         TDCpp_buffer<uint64_t> *packed_events);
+
+    /**
+     * Find the first common clock event between an object and the reference.
+     * Each clock delta of the object votes for the shifts at which the reference has a similar delta, so the cost
+     * does not depend on how far apart the two objects started. The matched clocks, the quality of the match and
+     * the time spent are recorded in TDCpp_metrics.
+     * @param box_index The index of the object in #boxes, at least 1.
+     * @param time_depth Size of the timestamps subarrays to confront, as well as the number of votes the best
+     * shift needs over the runner-up.
+     */
+    void find_match(uint64_t box_index, uint64_t time_depth);
+
+    /**
+     * Join the objects into one, shifting the timestamps and correcting for the time drift.
+     * The drift is corrected piecewise linearly, between each pair of matched clock events, so the error is
+     * bounded by the jitter of the clocks for the whole acquisition, see correct_drift().
+     * The events are merged straight from the arrays of the objects, see merge_sources().
+     * The joint time is split in parts with the same number of events, see split_sources(), which are merged
+     * at the same time. Every part starts from the state the serial merge would reach, so the result is the same.
+     * The time and the throughput are recorded in TDCpp_metrics.
+     * @param num_threads The number of threads used to merge the objects.
+     * @param packed_events If not null, the joint events are packed in it instead of the arrays of the object.
+     */
+    void merge(uint16_t num_threads, TDCpp_buffer<uint64_t> *packed_events);
+
+    /**
+     * @param source The events of an object.
+     * @param index The index of an event, in the arrays of the object.
+     * @return The timestamp of the event in the joint time, i.e. corrected and shifted.
+     */
+    uint64_t joint_time(const merge_source &source, uint64_t index) const;
+
+    /**
+     * Find a time that splits the events of the objects in two, and where it falls in each object.
+     * All the events before the split come before it in the joint time, all the ones after come at the same
+     * time or later, so the two halves can be merged on their own.
+     * @param sources The events of each object.
+     * @param target The number of events, clocks included, that should come before the split.
+     * @return The index of the first event after the split, for each object.
+     */
+    std::vector<uint64_t> split_sources(const std::vector<merge_source> &sources, uint64_t target) const;
+
+    /**
+     * Merge the events of the objects straight from their arrays into the joint ones. The first source is
+     * the reference, the other ones are read in blocks of #TDCPP_MERGE_BLOCK_SIZE events, dropping the clocks
+     * and correcting the drift on the way. The blocks are filled by the helper threads, ahead of the merge,
+     * or by the merge itself if there are none.
+     * @param sources The events of each object.
+     * @param joint_timestamp The destination timestamp array. Must be already allocated.
+     * @param joint_channel The destination channel array. Must be already allocated.
+     * @param joint_events If not null, the destination packed events, used instead of the two arrays.
+     * @param num_helpers The number of helper threads, at most one per object but the reference is used.
+     * @return The number of merged events.
      */
-    void find_match(uint64_t max_shift, uint64_t time_depth);
+    uint64_t merge_sources(const std::vector<merge_source> &sources, uint64_t *joint_timestamp,
+                           uint16_t *joint_channel, uint64_t *joint_events, uint16_t num_helpers);
 
     /**
-     * Join the two objects into one, shifting the timestamps and correcting for the time drift with a linear fit.
-     * @param max_fit_points Maximum number of clock events to use for the fit.
+     * Pair the clock events of an object with the ones of the reference, starting from a matched couple.
+     * Clock events that only one of the two recorded are skipped, their number is recorded in TDCpp_metrics.
+     * @param box_index The index of the object in #boxes, at least 1.
+     * @param reference_start The index of the first reference clock.
+     * @param box_start The index of the first clock of the object, matching reference_start.
+     * @param box_knots Filled with the timestamps of the paired clocks of the object, from the first one.
+     * @param reference_knots Filled with the timestamps of the paired reference clocks, from the first one.
      */
-    void merge(uint64_t max_fit_points);
+    void match_clocks(uint64_t box_index, uint64_t reference_start, uint64_t box_start,
+                      std::vector<uint64_t> &box_knots, std::vector<uint64_t> &reference_knots);
 };
 
 
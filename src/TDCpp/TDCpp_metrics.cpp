@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cinttypes>
+#include <cmath>
+#include <sys/resource.h>
+#include "TDCpp_metrics.h"
+#include "TDCpp_utils.h"
+
+std::vector<TDCpp_metrics::stage> TDCpp_metrics::stages;
+std::vector<std::pair<std::string, double>> TDCpp_metrics::values;
+std::chrono::steady_clock::time_point TDCpp_metrics::start_time = std::chrono::steady_clock::now();
+std::mutex TDCpp_metrics::metrics_mutex;
+
+/**
+ * Write a string as a JSON string, with the quotes.
+ */
+static void print_json_string(FILE *file, const std::string &text) {
+    fputc('"', file);
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if ((unsigned char) c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+void TDCpp_metrics::add_stage(const std::string &name, double seconds, uint64_t events, uint64_t bytes) {
+    std::lock_guard<std::mutex> guard(metrics_mutex);
+
+    stage new_stage;
+    new_stage.name = name;
+    new_stage.seconds = seconds;
+    new_stage.events = events;
+    new_stage.bytes = bytes;
+    stages.push_back(new_stage);
+}
+
+void TDCpp_metrics::set_value(const std::string &name, double value) {
+    std::lock_guard<std::mutex> guard(metrics_mutex);
+
+    for (auto &named_value : values) {
+        if (named_value.first == name) {
+            named_value.second = value;
+            return;
+        }
+    }
+    values.push_back(std::make_pair(name, value));
+}
+
+uint64_t TDCpp_metrics::get_peak_rss() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+    // Linux reports it in kilobytes.
+    return (uint64_t) usage.ru_maxrss * 1024;
+}
+
+void TDCpp_metrics::save(const char *file_name) {
+    std::lock_guard<std::mutex> guard(metrics_mutex);
+
+    FILE *metrics_file = fopen(file_name, "w");
+    if (metrics_file == NULL) {
+        std::string error_string("Can't write to  ");
+        error_string.append(file_name);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start_time;
+    fprintf(metrics_file, "{\n  \"wall_seconds\": %.9g,\n  \"peak_rss_bytes\": %" PRIu64 ",\n  \"stages\": [",
+            wall_time.count(), get_peak_rss());
+
+    for (uint64_t i = 0; i < stages.size(); ++i) {
+        const stage &current = stages[i];
+        // A stage too short to be measured has no rates.
+        double events_per_second = current.seconds > 0 ? current.events / current.seconds : 0;
+        double bytes_per_second = current.seconds > 0 ? current.bytes / current.seconds : 0;
+
+        fprintf(metrics_file, "%s\n    {\"name\": ", i == 0 ? "" : ",");
+        print_json_string(metrics_file, current.name);
+        fprintf(metrics_file, ", \"seconds\": %.9g, \"events\": %" PRIu64 ", \"bytes\": %" PRIu64
+                              ", \"events_per_second\": %.9g, \"bytes_per_second\": %.9g}",
+                current.seconds, current.events, current.bytes, events_per_second, bytes_per_second);
+    }
+
+    fprintf(metrics_file, "%s],\n  \"values\": {", stages.empty() ? "" : "\n  ");
+
+    for (uint64_t i = 0; i < values.size(); ++i) {
+        fprintf(metrics_file, "%s\n    ", i == 0 ? "" : ",");
+        print_json_string(metrics_file, values[i].first);
+        // Most values are counts or indices, they are written as whole numbers.
+        const double value = values[i].second;
+        fprintf(metrics_file, std::isfinite(value) && value == std::floor(value) ? ": %.0f" : ": %.9g", value);
+    }
+
+    fprintf(metrics_file, "%s}\n}\n", values.empty() ? "" : "\n  ");
+    fclose(metrics_file);
+}
+
+void TDCpp_metrics::reset() {
+    std::lock_guard<std::mutex> guard(metrics_mutex);
+
+    stages.clear();
+    values.clear();
+    start_time = std::chrono::steady_clock::now();
+}
+
+TDCpp_stage_timer::TDCpp_stage_timer(const char *name) {
+    this->name = name;
+    this->start_time = std::chrono::steady_clock::now();
+}
+
+double TDCpp_stage_timer::stop(uint64_t events, uint64_t bytes) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - this->start_time;
+    TDCpp_metrics::add_stage(this->name, elapsed.count(), events, bytes);
+    return elapsed.count();
+}
@@ -0,0 +1,128 @@
+#ifndef TDCPP_METRICS_H
+#define TDCPP_METRICS_H
+
+#include <stdint-gcc.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * The default name of the metrics file, written next to the results.
+ */
+#define TDCPP_METRICS_FILE "metrics.json"
+
+/**
+ * @brief This class collects the metrics of a run: the wall time, the events and the bytes of each stage,
+ * the peak memory use and named values such as the quality of the matches.
+ *
+ * The metrics are shared by the whole process, so that each stage records itself wherever it runs, and are
+ * saved as JSON at the end of the run. Recording is thread safe.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_metrics {
+
+protected:
+    /**
+     * A stage of the run.
+     */
+    struct stage {
+        std::string name;
+        /** The wall time, in seconds. */
+        double seconds;
+        /** The number of events and bytes processed, zero if they do not apply. */
+        uint64_t events, bytes;
+    };
+
+    /**
+     * The stages, in the order they ended.
+     */
+    static std::vector<stage> stages;
+
+    /**
+     * The named values, in the order they were set.
+     */
+    static std::vector<std::pair<std::string, double>> values;
+
+    /**
+     * When the metrics started, i.e. when the process started or the last reset().
+     */
+    static std::chrono::steady_clock::time_point start_time;
+
+    /**
+     * Protects #stages and #values.
+     */
+    static std::mutex metrics_mutex;
+
+public:
+    /**
+     * Record a stage.
+     * @param name The name of the stage, e.g. load.
+     * @param seconds The wall time of the stage.
+     * @param events The number of events processed by the stage.
+     * @param bytes The number of bytes read or written by the stage.
+     */
+    static void add_stage(const std::string &name, double seconds, uint64_t events, uint64_t bytes = 0);
+
+    /**
+     * Record a named value, replacing the previous one with the same name.
+     * @param name The name of the value.
+     * @param value The value.
+     */
+    static void set_value(const std::string &name, double value);
+
+    /**
+     * @return The peak resident memory of the process, in bytes.
+     */
+    static uint64_t get_peak_rss();
+
+    /**
+     * Save the metrics as JSON. Each stage has its rates in events/s and bytes/s. The values that are whole numbers
+     * are written as such, the others with 9 significant digits.
+     * @param file_name The name of the file.
+     */
+    static void save(const char *file_name = TDCPP_METRICS_FILE);
+
+    /**
+     * Forget all the stages and the values, and start measuring the wall time again.
+     */
+    static void reset();
+};
+
+/**
+ * @brief This class measures the wall time of a stage, from its construction to stop().
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_stage_timer {
+
+protected:
+    /**
+     * The name of the stage.
+     */
+    std::string name;
+
+    /**
+     * When the stage started.
+     */
+    std::chrono::steady_clock::time_point start_time;
+
+public:
+    /**
+     * This is the default constructor, the stage starts now.
+     * @param name The name of the stage.
+     */
+    explicit TDCpp_stage_timer(const char *name);
+
+    /**
+     * Record the stage in TDCpp_metrics. A stage that is not stopped, e.g. because of an error, is not recorded.
+     * @param events The number of events processed by the stage.
+     * @param bytes The number of bytes read or written by the stage.
+     * @return The wall time of the stage, in seconds.
+     */
+    double stop(uint64_t events, uint64_t bytes = 0);
+};
+
+#endif //TDCPP_METRICS_H
@@ -0,0 +1,73 @@
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "TDCpp_mmap.h"
+
+TDCpp_mapped_file::TDCpp_mapped_file(const char *data_file_path) {
+    this->mapping = nullptr;
+    this->mapping_size = 0;
+    this->records = nullptr;
+    this->size = 0;
+
+    int data_file = open(data_file_path, O_RDONLY);
+
+    if (data_file < 0) {
+        // The file was not found. Throw an error and exit.
+        std::string error_string("File not found, ");
+        error_string.append(data_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    struct stat file_stat;
+    if (fstat(data_file, &file_stat) != 0) {
+        close(data_file);
+        std::string error_string("Could not stat the file ");
+        error_string.append(data_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    // Same rule as TDCpp_data::get_file_size: the file must hold at least the header and one record.
+    if ((uint64_t) file_stat.st_size > TDCPP_HEADER_SIZE + TDCPP_RECORD_SIZE) {
+        this->mapping_size = (uint64_t) file_stat.st_size;
+        void *mapped = mmap(nullptr, this->mapping_size, PROT_READ, MAP_PRIVATE, data_file, 0);
+
+        if (mapped == MAP_FAILED) {
+            close(data_file);
+            std::string error_string("Could not map the file ");
+            error_string.append(data_file_path);
+            log_error_and_exit(error_string.c_str());
+        }
+
+        // We are going to read the file only once, from the beginning to the end.
+        madvise(mapped, this->mapping_size, MADV_SEQUENTIAL);
+
+        this->mapping = (char *) mapped;
+        this->records = this->mapping + TDCPP_HEADER_SIZE;
+        this->size = (this->mapping_size - TDCPP_HEADER_SIZE) / TDCPP_RECORD_SIZE;
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    close(data_file);
+}
+
+TDCpp_mapped_file::~TDCpp_mapped_file() {
+    if (this->mapping) {
+        munmap(this->mapping, this->mapping_size);
+    }
+}
+
+void TDCpp_mapped_file::release(uint64_t end_index) {
+    if (this->mapping == nullptr) return;
+
+    // Only whole pages can be released, round down to the page boundary.
+    const uint64_t page_size = (uint64_t) sysconf(_SC_PAGESIZE);
+    uint64_t end_byte = TDCPP_HEADER_SIZE + end_index * TDCPP_RECORD_SIZE;
+    if (end_byte > this->mapping_size) end_byte = this->mapping_size;
+    end_byte -= end_byte % page_size;
+
+    if (end_byte > 0) {
+        madvise(this->mapping, end_byte, MADV_DONTNEED);
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef TDCPP_MMAP_H
+#define TDCPP_MMAP_H
+
+#include <cstring>
+#include "TDCpp_data.h"
+
+/**
+ * @brief This class maps a timestamp file from ID800-TDC in memory and gives read-only access to its records.
+ *
+ * The records are read in place, directly from the page cache, so no copy of the file is ever made.
+ * The mapping is advised as sequential, so that the kernel reads ahead aggressively and drops the pages
+ * that have already been consumed.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_mapped_file {
+
+protected:
+    /**
+     * A pointer to the beginning of the mapped file, i.e. to the header.
+     */
+    char *mapping;
+
+    /**
+     * The size in bytes of #mapping.
+     */
+    uint64_t mapping_size;
+
+    /**
+     * A pointer to the first record, i.e. #mapping plus #TDCPP_HEADER_SIZE.
+     */
+    const char *records;
+
+    /**
+     * The number of complete records in the file.
+     */
+    uint64_t size;
+
+public:
+    /**
+     * This is the default constructor. It opens and maps the file.
+     * @param data_file_path The path of the timestamp file to be mapped.
+     */
+    explicit TDCpp_mapped_file(const char *data_file_path);
+
+    /**
+     * This is the default destructor. It unmaps the file.
+     */
+    virtual ~TDCpp_mapped_file();
+
+    /**
+     * @return The number of records in the file.
+     */
+    uint64_t get_size() const {
+        return size;
+    }
+
+    /**
+     * @return A pointer to the first packed record, each one is #TDCPP_RECORD_SIZE bytes long.
+     */
+    const char *get_records() const {
+        return records;
+    }
+
+    /**
+     * @param index The index of the record
+     * @return The timestamp of the record
+     */
+    uint64_t get_timestamp(uint64_t index) const {
+        uint64_t value;
+        memcpy(&value, records + index * TDCPP_RECORD_SIZE, TDCPP_TIMESTAMP_SIZE);
+        return value;
+    }
+
+    /**
+     * @param index The index of the record
+     * @return The channel of the record, as stored in the file (i.e. from 0 to max_channel-1)
+     */
+    uint16_t get_channel(uint64_t index) const {
+        uint16_t value;
+        memcpy(&value, records + index * TDCPP_RECORD_SIZE + TDCPP_TIMESTAMP_SIZE, TDCPP_CHANNEL_SIZE);
+        return value;
+    }
+
+    /**
+     * Tell the kernel that the records in [0, end_index) are not going to be read again,
+     * so that their pages can be dropped from memory.
+     * @param end_index The index of the first record that is still needed.
+     */
+    void release(uint64_t end_index);
+
+private:
+    /**
+     * Deleted copy constructor, a mapping can not be shared.
+     */
+    TDCpp_mapped_file(const TDCpp_mapped_file &) = delete;
+
+    /**
+     * Deleted assignment operator, a mapping can not be shared.
+     */
+    TDCpp_mapped_file &operator=(const TDCpp_mapped_file &) = delete;
+};
+
+#endif //TDCPP_MMAP_H
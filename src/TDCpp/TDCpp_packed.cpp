@@ -0,0 +1,167 @@
+#include <cstring>
+#include "TDCpp_packed.h"
+#include "TDCpp_merger.h"
+#include "TDCpp_mmap.h"
+#include "TDCpp_sort.h"
+#include "TDCpp_metrics.h"
+
+TDCpp_packed::TDCpp_packed() {
+    this->events = nullptr;
+    this->size = 0;
+    this->init(8, 8, 1);
+}
+
+TDCpp_packed::TDCpp_packed(const TDCpp_data &data) : TDCpp_packed() {
+    TDCpp_stage_timer timer("pack");
+
+    if (data.get_channels_number() > TDCPP_PACKED_MAX_CHANNELS) {
+        log_error_and_exit("Too many channels to pack the events.");
+    }
+
+    this->init(data.get_channels_number(), data.get_clock_channel(), data.get_box_number());
+    this->size = data.get_size();
+    this->events = this->events_buffer.allocate(this->size);
+    if (this->events == nullptr) {
+        log_error_and_exit("Could not allocate the memory for the events.");
+    }
+
+    const uint64_t *timestamp = data.get_timestamp_array();
+    const uint16_t *channel = data.get_channel_array();
+    uint64_t all_timestamps = 0;
+    for (uint64_t i = 0; i < this->size; ++i) {
+        all_timestamps |= timestamp[i];
+        this->events[i] = pack_event(timestamp[i], channel[i]);
+    }
+
+    if (all_timestamps > TDCPP_PACKED_MAX_TIMESTAMP) {
+        log_error_and_exit("The timestamps are too big to pack the events.");
+    }
+
+    timer.stop(this->size);
+}
+
+TDCpp_packed::TDCpp_packed(const std::vector<TDCpp_data *> &boxes, uint16_t num_threads) : TDCpp_packed() {
+    TDCpp_merger merger(boxes, this->events_buffer, num_threads);
+
+    this->init(merger.get_channels_number(), merger.get_clock_channel(), merger.get_box_number());
+    this->events = this->events_buffer.data();
+    this->size = this->events_buffer.get_size();
+}
+
+TDCpp_packed::~TDCpp_packed() {
+}
+
+void TDCpp_packed::init(uint16_t num_channels, uint16_t clock, uint16_t box_number) {
+    this->num_channels = num_channels;
+    this->clock = clock;
+    this->box_number = box_number;
+
+    if (this->offset_buffer.allocate_zeroed(this->num_channels) == nullptr) {
+        log_error_and_exit("Could not allocate the memory for the offsets.");
+    }
+}
+
+void TDCpp_packed::load_from_file(const char *data_file_path, uint16_t clock, uint16_t box_number) {
+    TDCpp_stage_timer timer("load");
+
+    // Map the file, the header is skipped by the mapping itself.
+    TDCpp_mapped_file data_file(data_file_path);
+
+    this->init(8, clock, box_number);
+    this->size = data_file.get_size();
+    this->events = this->events_buffer.allocate(this->size);
+    if (this->events == nullptr) {
+        log_error_and_exit("Could not allocate the memory for the events.");
+    }
+
+    // Pack each record straight from the mapping.
+    const char *records = data_file.get_records();
+    uint64_t all_timestamps = 0;
+    uint16_t all_channels = 0;
+    for (uint64_t i = 0; i < this->size; ++i) {
+        uint64_t record_timestamp;
+        uint16_t record_channel;
+        memcpy(&record_timestamp, records + i * TDCPP_RECORD_SIZE, TDCPP_TIMESTAMP_SIZE);
+        memcpy(&record_channel, records + i * TDCPP_RECORD_SIZE + TDCPP_TIMESTAMP_SIZE, TDCPP_CHANNEL_SIZE);
+        all_timestamps |= record_timestamp;
+        all_channels |= record_channel;
+        this->events[i] = pack_event(record_timestamp, record_channel);
+    }
+
+    if (all_timestamps > TDCPP_PACKED_MAX_TIMESTAMP || all_channels >= TDCPP_PACKED_MAX_CHANNELS) {
+        std::string error_string("The events are too big to be packed, ");
+        error_string.append(data_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    timer.stop(this->size, TDCPP_HEADER_SIZE + this->size * TDCPP_RECORD_SIZE);
+}
+
+void TDCpp_packed::set_channel_offset(const char *offset_file_path) {
+    TDCpp_buffer<int16_t> file_offset;
+    if (file_offset.allocate_zeroed(this->num_channels) == nullptr) {
+        log_error_and_exit("Could not allocate the memory for the offsets.");
+    }
+
+    load_channel_offsets(offset_file_path, file_offset.data(), this->num_channels);
+    this->set_channel_offset(file_offset.data());
+}
+
+void TDCpp_packed::set_channel_offset(const int16_t *channel_offset) {
+    TDCpp_stage_timer timer("offset_sort");
+
+    // The same shifts as TDCpp_data::set_channel_offset(), all the timestamps stay positive.
+    int16_t max_offset = 0;
+    for (uint16_t i = 0; i < this->num_channels; ++i) {
+        this->offset_buffer[i] = channel_offset[i];
+        if (max_offset > channel_offset[i]) max_offset = channel_offset[i];
+    }
+
+    std::vector<uint64_t> channel_shift(this->num_channels);
+    uint64_t max_shift = 0;
+    for (uint16_t i = 0; i < this->num_channels; ++i) {
+        channel_shift[i] = (uint64_t) (-max_offset + channel_offset[i]);
+        if (channel_shift[i] > max_shift) max_shift = channel_shift[i];
+    }
+
+    // The events are sorted, the last one has the biggest timestamp.
+    if (this->size > 0 && packed_timestamp(this->events[this->size - 1]) > TDCPP_PACKED_MAX_TIMESTAMP - max_shift) {
+        log_error_and_exit("The timestamps are too big to pack the events.");
+    }
+
+    // The shift of the timestamp is added to the word, the channel is left as it is.
+    for (uint64_t i = 0; i < this->size; ++i) {
+        this->events[i] += channel_shift[packed_channel(this->events[i])] << TDCPP_PACKED_CHANNEL_BITS;
+    }
+
+    // Each channel is still sorted, merge them back together.
+    sort_shifted_packed_events(this->events, this->size, channel_shift.data(), this->num_channels);
+    timer.stop(this->size);
+}
+
+void TDCpp_packed::find_n_fold_coincidences(uint16_t n,
+                                            const char *singles_file_name,
+                                            const char *coincidences_file_name,
+                                            uint64_t coincidence_window,
+                                            bool legacyFormat,
+                                            uint16_t num_threads) {
+    save_event_coincidences(tdcpp_packed_events{this->events}, this->size, this->num_channels, n, singles_file_name,
+                            coincidences_file_name, std::vector<uint64_t>(1, coincidence_window), false,
+                            legacyFormat, num_threads);
+}
+
+void TDCpp_packed::sweep_n_fold_coincidences(uint16_t n,
+                                             const char *singles_file_name,
+                                             const char *coincidences_file_name,
+                                             const std::vector<uint64_t> &coincidence_windows,
+                                             bool legacyFormat,
+                                             uint16_t num_threads) {
+    save_event_coincidences(tdcpp_packed_events{this->events}, this->size, this->num_channels, n, singles_file_name,
+                            coincidences_file_name, coincidence_windows, true, legacyFormat, num_threads);
+}
+
+void TDCpp_packed::print_data_to_file(const char *output_file_path, uint16_t num_threads) {
+    // The channels are printed as in get_channel().
+    print_events_to_file(tdcpp_packed_events{this->events}, this->size, (uint16_t) ((this->box_number - 1) * 8 + 1),
+                         output_file_path, num_threads);
+}
@@ -0,0 +1,110 @@
+#include <cstring>
+#include <immintrin.h>
+#include "TDCpp_data.h"
+#include "TDCpp_records.h"
+
+/**
+ * The vector kernels split 8 records per iteration. The last 16 byte load of a group starts at byte 70
+ * and ends at byte 85, so a group is processed only if at least one more record follows it.
+ */
+#define TDCPP_RECORDS_PER_GROUP 8
+#define TDCPP_RECORDS_SAFE_GROUP (TDCPP_RECORDS_PER_GROUP + 1)
+
+typedef void (*deinterleave_kernel)(const char *, uint64_t, uint64_t *, uint16_t *);
+
+void deinterleave_records_scalar(const char *records, uint64_t n_records, uint64_t *timestamp, uint16_t *channel) {
+    for (uint64_t i = 0; i < n_records; i++) {
+        memcpy(timestamp + i, records + i * TDCPP_RECORD_SIZE, TDCPP_TIMESTAMP_SIZE);
+        memcpy(channel + i, records + i * TDCPP_RECORD_SIZE + TDCPP_TIMESTAMP_SIZE, TDCPP_CHANNEL_SIZE);
+    }
+}
+
+__attribute__((target("sse4.1")))
+void deinterleave_records_sse41(const char *records, uint64_t n_records, uint64_t *timestamp, uint16_t *channel) {
+    uint64_t i = 0;
+
+    for (; i + TDCPP_RECORDS_SAFE_GROUP <= n_records; i += TDCPP_RECORDS_PER_GROUP) {
+        const char *group = records + i * TDCPP_RECORD_SIZE;
+
+        // Each load has the timestamp in the low 8 bytes and the channel in the 16bit lane 4.
+        __m128i r0 = _mm_loadu_si128((const __m128i *) (group + 0 * TDCPP_RECORD_SIZE));
+        __m128i r1 = _mm_loadu_si128((const __m128i *) (group + 1 * TDCPP_RECORD_SIZE));
+        __m128i r2 = _mm_loadu_si128((const __m128i *) (group + 2 * TDCPP_RECORD_SIZE));
+        __m128i r3 = _mm_loadu_si128((const __m128i *) (group + 3 * TDCPP_RECORD_SIZE));
+        __m128i r4 = _mm_loadu_si128((const __m128i *) (group + 4 * TDCPP_RECORD_SIZE));
+        __m128i r5 = _mm_loadu_si128((const __m128i *) (group + 5 * TDCPP_RECORD_SIZE));
+        __m128i r6 = _mm_loadu_si128((const __m128i *) (group + 6 * TDCPP_RECORD_SIZE));
+        __m128i r7 = _mm_loadu_si128((const __m128i *) (group + 7 * TDCPP_RECORD_SIZE));
+
+        _mm_storeu_si128((__m128i *) (timestamp + i + 0), _mm_unpacklo_epi64(r0, r1));
+        _mm_storeu_si128((__m128i *) (timestamp + i + 2), _mm_unpacklo_epi64(r2, r3));
+        _mm_storeu_si128((__m128i *) (timestamp + i + 4), _mm_unpacklo_epi64(r4, r5));
+        _mm_storeu_si128((__m128i *) (timestamp + i + 6), _mm_unpacklo_epi64(r6, r7));
+
+        // Gather the 16bit lanes 4 of each load into the low lanes.
+        __m128i c01 = _mm_unpackhi_epi16(r0, r1);
+        __m128i c23 = _mm_unpackhi_epi16(r2, r3);
+        __m128i c45 = _mm_unpackhi_epi16(r4, r5);
+        __m128i c67 = _mm_unpackhi_epi16(r6, r7);
+        __m128i c0123 = _mm_unpacklo_epi32(c01, c23);
+        __m128i c4567 = _mm_unpacklo_epi32(c45, c67);
+        _mm_storeu_si128((__m128i *) (channel + i), _mm_unpacklo_epi64(c0123, c4567));
+    }
+
+    deinterleave_records_scalar(records + i * TDCPP_RECORD_SIZE, n_records - i, timestamp + i, channel + i);
+}
+
+__attribute__((target("avx2")))
+void deinterleave_records_avx2(const char *records, uint64_t n_records, uint64_t *timestamp, uint16_t *channel) {
+    // Moves the 32bit lanes {0, 4, 1, 5} in the low 128bit.
+    const __m256i channel_permutation = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    uint64_t i = 0;
+
+    for (; i + TDCPP_RECORDS_SAFE_GROUP <= n_records; i += TDCPP_RECORDS_PER_GROUP) {
+        const char *group = records + i * TDCPP_RECORD_SIZE;
+
+        // Each 128bit lane holds one record, the pairs are arranged so that unpacking
+        // gives timestamps that are already in order: y0 = [r0|r2], y1 = [r1|r3], ...
+        __m256i y0 = _mm256_loadu2_m128i((const __m128i *) (group + 2 * TDCPP_RECORD_SIZE),
+                                         (const __m128i *) (group + 0 * TDCPP_RECORD_SIZE));
+        __m256i y1 = _mm256_loadu2_m128i((const __m128i *) (group + 3 * TDCPP_RECORD_SIZE),
+                                         (const __m128i *) (group + 1 * TDCPP_RECORD_SIZE));
+        __m256i y2 = _mm256_loadu2_m128i((const __m128i *) (group + 6 * TDCPP_RECORD_SIZE),
+                                         (const __m128i *) (group + 4 * TDCPP_RECORD_SIZE));
+        __m256i y3 = _mm256_loadu2_m128i((const __m128i *) (group + 7 * TDCPP_RECORD_SIZE),
+                                         (const __m128i *) (group + 5 * TDCPP_RECORD_SIZE));
+
+        _mm256_storeu_si256((__m256i *) (timestamp + i + 0), _mm256_unpacklo_epi64(y0, y1));
+        _mm256_storeu_si256((__m256i *) (timestamp + i + 4), _mm256_unpacklo_epi64(y2, y3));
+
+        // Lane 0 gets c0 c1 c4 c5, lane 1 gets c2 c3 c6 c7, then the permutation puts them in order.
+        __m256i c0123 = _mm256_unpackhi_epi16(y0, y1);
+        __m256i c4567 = _mm256_unpackhi_epi16(y2, y3);
+        __m256i channels = _mm256_permutevar8x32_epi32(_mm256_unpacklo_epi32(c0123, c4567), channel_permutation);
+        _mm_storeu_si128((__m128i *) (channel + i), _mm256_castsi256_si128(channels));
+    }
+
+    deinterleave_records_scalar(records + i * TDCPP_RECORD_SIZE, n_records - i, timestamp + i, channel + i);
+}
+
+/**
+ * @return The fastest kernel supported by the CPU.
+ */
+static deinterleave_kernel select_kernel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return deinterleave_records_avx2;
+    if (__builtin_cpu_supports("sse4.1")) return deinterleave_records_sse41;
+    return deinterleave_records_scalar;
+}
+
+void deinterleave_records(const char *records, uint64_t n_records, uint64_t *timestamp, uint16_t *channel) {
+    static const deinterleave_kernel kernel = select_kernel();
+    kernel(records, n_records, timestamp, channel);
+}
+
+const char *deinterleave_records_kernel() {
+    deinterleave_kernel kernel = select_kernel();
+    if (kernel == deinterleave_records_avx2) return "avx2";
+    if (kernel == deinterleave_records_sse41) return "sse4.1";
+    return "scalar";
+}
@@ -0,0 +1,38 @@
+#ifndef TDCPP_RECORDS_H
+#define TDCPP_RECORDS_H
+
+#include <stdint-gcc.h>
+
+/**
+ * Split a stream of packed records (#TDCPP_RECORD_SIZE bytes each) into the timestamp and channel arrays.
+ * The fastest kernel supported by the CPU (AVX2, SSE4.1 or scalar) is chosen at runtime, the first time
+ * this function is called.
+ *
+ * @param records A pointer to the first packed record.
+ * @param n_records The number of records to split.
+ * @param timestamp The destination timestamp array. Must be already allocated.
+ * @param channel The destination channel array. Must be already allocated.
+ */
+void deinterleave_records(const char *records, uint64_t n_records, uint64_t *timestamp, uint16_t *channel);
+
+/**
+ * Scalar version of deinterleave_records(), it is the fallback for older CPUs.
+ */
+void deinterleave_records_scalar(const char *records, uint64_t n_records, uint64_t *timestamp, uint16_t *channel);
+
+/**
+ * SSE4.1 version of deinterleave_records(). The CPU must support SSE4.1.
+ */
+void deinterleave_records_sse41(const char *records, uint64_t n_records, uint64_t *timestamp, uint16_t *channel);
+
+/**
+ * AVX2 version of deinterleave_records(). The CPU must support AVX2.
+ */
+void deinterleave_records_avx2(const char *records, uint64_t n_records, uint64_t *timestamp, uint16_t *channel);
+
+/**
+ * @return The name of the kernel used by deinterleave_records(), i.e. "avx2", "sse4.1" or "scalar".
+ */
+const char *deinterleave_records_kernel();
+
+#endif //TDCPP_RECORDS_H
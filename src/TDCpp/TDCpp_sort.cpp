@@ -0,0 +1,251 @@
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include "TDCpp_sort.h"
+#include "TDCpp_utils.h"
+#include "TDCpp_buffer.h"
+#include "TDCpp_packed.h"
+
+/**
+ * The value given to the head of an exhausted stream, it loses against any event.
+ */
+#define TDCPP_SORT_EXHAUSTED UINT64_MAX
+
+/**
+ * @return True if the event (timestamp_a, channel_a) comes before the event (timestamp_b, channel_b).
+ */
+static inline bool is_event_before(uint64_t timestamp_a, uint16_t channel_a,
+                                   uint64_t timestamp_b, uint16_t channel_b, const uint64_t *channel_shift) {
+    // Ties are rare, so only the first comparison is on the hot path.
+    if (__builtin_expect(timestamp_a == timestamp_b, 0)) {
+        uint64_t original_a = timestamp_a - channel_shift[channel_a];
+        uint64_t original_b = timestamp_b - channel_shift[channel_b];
+        if (original_a != original_b) return original_a < original_b;
+        return channel_a < channel_b;
+    }
+    return timestamp_a < timestamp_b;
+}
+
+/**
+ * @return True if the packed event a comes before the packed event b, in the same order as is_event_before().
+ */
+static inline bool is_packed_event_before(uint64_t a, uint64_t b, const uint64_t *channel_shift) {
+    // With different timestamps the words compare as the events.
+    if (__builtin_expect(packed_timestamp(a) == packed_timestamp(b), 0)) {
+        return is_event_before(packed_timestamp(a), packed_channel(a), packed_timestamp(b), packed_channel(b),
+                               channel_shift);
+    }
+    return a < b;
+}
+
+void sort_shifted_channels(uint64_t *timestamp, uint16_t *channel, uint64_t size,
+                           const uint64_t *channel_shift, uint16_t num_channels) {
+    if (size < 2) return;
+
+    uint64_t min_shift = channel_shift[0], max_shift = channel_shift[0];
+    for (uint16_t c = 1; c < num_channels; ++c) {
+        if (channel_shift[c] < min_shift) min_shift = channel_shift[c];
+        if (channel_shift[c] > max_shift) max_shift = channel_shift[c];
+    }
+
+    // An event can move at most by the events that fall inside the spread of the shifts.
+    uint64_t duration = timestamp[size - 1] > timestamp[0] ? timestamp[size - 1] - timestamp[0] : 1;
+    double displacement = (double) (max_shift - min_shift) * size / duration;
+
+    if (displacement <= TDCPP_SORT_MAX_INSERTION_DISPLACEMENT) {
+        insertion_sort_shifted_channels(timestamp, channel, size, channel_shift);
+    } else {
+        merge_shifted_channels(timestamp, channel, size, channel_shift, num_channels);
+    }
+}
+
+void insertion_sort_shifted_channels(uint64_t *timestamp, uint16_t *channel, uint64_t size,
+                                     const uint64_t *channel_shift) {
+    for (uint64_t i = 1; i < size; ++i) {
+        uint64_t sorting_timestamp = timestamp[i];
+        uint16_t sorting_channel = channel[i];
+        uint64_t j = i;
+
+        while (j > 0 && is_event_before(sorting_timestamp, sorting_channel, timestamp[j - 1], channel[j - 1],
+                                        channel_shift)) {
+            timestamp[j] = timestamp[j - 1];
+            channel[j] = channel[j - 1];
+            j--;
+        }
+
+        timestamp[j] = sorting_timestamp;
+        channel[j] = sorting_channel;
+    }
+}
+
+void merge_shifted_channels(uint64_t *timestamp, uint16_t *channel, uint64_t size,
+                            const uint64_t *channel_shift, uint16_t num_channels) {
+    if (size < 2) return;
+
+    // Count the events of each channel, to find where each stream starts.
+    std::vector<uint64_t> stream_start(num_channels + 1, 0);
+    for (uint64_t i = 0; i < size; ++i) {
+        stream_start[channel[i] + 1]++;
+    }
+    for (uint16_t c = 0; c < num_channels; ++c) {
+        stream_start[c + 1] += stream_start[c];
+    }
+
+    // Split the streams, keeping the order of the events of each channel.
+    TDCpp_buffer<uint64_t> scratch_buffer;
+    uint64_t *scratch = scratch_buffer.allocate(size);
+    if (scratch == NULL) {
+        log_error_and_exit("Could not allocate the memory to sort the events.");
+    }
+
+    std::vector<uint64_t> stream_cursor(stream_start.begin(), stream_start.end() - 1);
+    for (uint64_t i = 0; i < size; ++i) {
+        scratch[stream_cursor[channel[i]]++] = timestamp[i];
+    }
+    for (uint16_t c = 0; c < num_channels; ++c) {
+        stream_cursor[c] = stream_start[c];
+    }
+
+    // The tournament tree has a leaf per channel, padded to a power of two with exhausted streams.
+    // Each internal node keeps the head of the stream that lost the match played there, so that
+    // replacing the winner only needs the log2(k) matches on the path from its leaf to the root.
+    uint16_t leaves = 1;
+    while (leaves < num_channels) leaves *= 2;
+
+    std::vector<uint64_t> shift(leaves, 0);
+    std::copy(channel_shift, channel_shift + num_channels, shift.begin());
+
+    std::vector<uint64_t> winner_head(2 * leaves, TDCPP_SORT_EXHAUSTED);
+    std::vector<uint16_t> winner_stream(2 * leaves);
+    for (uint16_t c = 0; c < leaves; ++c) {
+        winner_stream[leaves + c] = c;
+        if (c < num_channels && stream_start[c] < stream_start[c + 1]) winner_head[leaves + c] = scratch[stream_start[c]];
+    }
+
+    std::vector<uint64_t> loser_head(leaves);
+    std::vector<uint16_t> loser_stream(leaves);
+    for (uint16_t node = (uint16_t) (leaves - 1); node >= 1; --node) {
+        uint16_t left = (uint16_t) (2 * node), right = (uint16_t) (2 * node + 1);
+        bool is_left_winner = is_event_before(winner_head[left], winner_stream[left],
+                                              winner_head[right], winner_stream[right], shift.data());
+        uint16_t winner = is_left_winner ? left : right, loser = is_left_winner ? right : left;
+        winner_head[node] = winner_head[winner];
+        winner_stream[node] = winner_stream[winner];
+        loser_head[node] = winner_head[loser];
+        loser_stream[node] = winner_stream[loser];
+    }
+
+    uint64_t current_head = winner_head[1];
+    uint16_t current_stream = winner_stream[1];
+
+    // Join the streams back.
+    for (uint64_t joint_index = 0; joint_index < size; ++joint_index) {
+        timestamp[joint_index] = current_head;
+        channel[joint_index] = current_stream;
+
+        uint64_t position = ++stream_cursor[current_stream];
+        current_head = position < stream_start[current_stream + 1] ? scratch[position] : TDCPP_SORT_EXHAUSTED;
+
+        // Replay the matches up to the root. They are unpredictable, so select without branching.
+        for (uint16_t node = (uint16_t) ((leaves + current_stream) / 2); node >= 1; node /= 2) {
+            uint64_t challenger_head = loser_head[node];
+            uint16_t challenger_stream = loser_stream[node];
+            bool is_challenger_before = is_event_before(challenger_head, challenger_stream,
+                                                        current_head, current_stream, shift.data());
+            loser_head[node] = is_challenger_before ? current_head : challenger_head;
+            loser_stream[node] = is_challenger_before ? current_stream : challenger_stream;
+            current_head = is_challenger_before ? challenger_head : current_head;
+            current_stream = is_challenger_before ? challenger_stream : current_stream;
+        }
+    }
+}
+
+void sort_shifted_packed_events(uint64_t *events, uint64_t size, const uint64_t *channel_shift,
+                                uint16_t num_channels) {
+    if (size < 2) return;
+
+    // A shift for every channel that fits in a packed event, so that the exhausted streams can be compared.
+    std::vector<uint64_t> shift(TDCPP_PACKED_MAX_CHANNELS, 0);
+    std::copy(channel_shift, channel_shift + num_channels, shift.begin());
+
+    uint64_t min_shift = channel_shift[0], max_shift = channel_shift[0];
+    for (uint16_t c = 1; c < num_channels; ++c) {
+        if (channel_shift[c] < min_shift) min_shift = channel_shift[c];
+        if (channel_shift[c] > max_shift) max_shift = channel_shift[c];
+    }
+
+    // The same choice as sort_shifted_channels().
+    uint64_t first_timestamp = packed_timestamp(events[0]), last_timestamp = packed_timestamp(events[size - 1]);
+    uint64_t duration = last_timestamp > first_timestamp ? last_timestamp - first_timestamp : 1;
+    double displacement = (double) (max_shift - min_shift) * size / duration;
+
+    if (displacement <= TDCPP_SORT_MAX_INSERTION_DISPLACEMENT) {
+        for (uint64_t i = 1; i < size; ++i) {
+            uint64_t sorting_event = events[i];
+            uint64_t j = i;
+            while (j > 0 && is_packed_event_before(sorting_event, events[j - 1], shift.data())) {
+                events[j] = events[j - 1];
+                j--;
+            }
+            events[j] = sorting_event;
+        }
+        return;
+    }
+
+    // The k-way merge of merge_shifted_channels(). Each head carries its channel, i.e. its stream, so the
+    // tournament tree only keeps the heads.
+    std::vector<uint64_t> stream_start(num_channels + 1, 0);
+    for (uint64_t i = 0; i < size; ++i) {
+        stream_start[packed_channel(events[i]) + 1]++;
+    }
+    for (uint16_t c = 0; c < num_channels; ++c) {
+        stream_start[c + 1] += stream_start[c];
+    }
+
+    TDCpp_buffer<uint64_t> scratch_buffer;
+    uint64_t *scratch = scratch_buffer.allocate(size);
+    if (scratch == NULL) {
+        log_error_and_exit("Could not allocate the memory to sort the events.");
+    }
+
+    std::vector<uint64_t> stream_cursor(stream_start.begin(), stream_start.end() - 1);
+    for (uint64_t i = 0; i < size; ++i) {
+        scratch[stream_cursor[packed_channel(events[i])]++] = events[i];
+    }
+    for (uint16_t c = 0; c < num_channels; ++c) {
+        stream_cursor[c] = stream_start[c];
+    }
+
+    uint16_t leaves = 1;
+    while (leaves < num_channels) leaves *= 2;
+
+    std::vector<uint64_t> winner_head(2 * leaves, TDCPP_SORT_EXHAUSTED);
+    for (uint16_t c = 0; c < num_channels; ++c) {
+        if (stream_start[c] < stream_start[c + 1]) winner_head[leaves + c] = scratch[stream_start[c]];
+    }
+
+    std::vector<uint64_t> loser_head(leaves);
+    for (uint16_t node = (uint16_t) (leaves - 1); node >= 1; --node) {
+        uint64_t left = winner_head[2 * node], right = winner_head[2 * node + 1];
+        bool is_left_winner = is_packed_event_before(left, right, shift.data());
+        winner_head[node] = is_left_winner ? left : right;
+        loser_head[node] = is_left_winner ? right : left;
+    }
+
+    uint64_t current_head = winner_head[1];
+
+    for (uint64_t joint_index = 0; joint_index < size; ++joint_index) {
+        events[joint_index] = current_head;
+
+        uint16_t current_stream = packed_channel(current_head);
+        uint64_t position = ++stream_cursor[current_stream];
+        current_head = position < stream_start[current_stream + 1] ? scratch[position] : TDCPP_SORT_EXHAUSTED;
+
+        for (uint16_t node = (uint16_t) ((leaves + current_stream) / 2); node >= 1; node /= 2) {
+            uint64_t challenger_head = loser_head[node];
+            bool is_challenger_before = is_packed_event_before(challenger_head, current_head, shift.data());
+            loser_head[node] = is_challenger_before ? current_head : challenger_head;
+            current_head = is_challenger_before ? challenger_head : current_head;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef TDCPP_SORT_H
+#define TDCPP_SORT_H
+
+#include <stdint-gcc.h>
+
+/**
+ * If the events move on average by less than this many positions, insertion sort is faster than the merge.
+ */
+#define TDCPP_SORT_MAX_INSERTION_DISPLACEMENT 64
+
+/**
+ * @brief Sort events whose timestamps have been shifted by a constant per channel.
+ *
+ * A constant shift keeps the events of each channel sorted, so instead of sorting the whole array the
+ * per-channel streams are split apart and then joined back with merge_shifted_channels(), in O(n log k) time
+ * (k being the number of channels). If the spread of the shifts covers only a handful of events, the array is
+ * nearly sorted and insertion_sort_shifted_channels() is used instead, since it is O(n) in that case.
+ *
+ * Events with the same shifted timestamp are ordered by their original (unshifted) timestamp, then by channel.
+ * This is the order that a stable sort of the shifted array gives, unless two events on different
+ * channels with the same offset had exactly the same original timestamp. Both algorithms give exactly
+ * the same result.
+ *
+ * @param timestamp The shifted timestamps. The events of each channel must be sorted.
+ * @param channel The channels of the events, from 0 to num_channels-1.
+ * @param size The number of events.
+ * @param channel_shift The shift that was applied to each channel.
+ * @param num_channels The number of channels, i.e. the size of channel_shift.
+ */
+void sort_shifted_channels(uint64_t *timestamp, uint16_t *channel, uint64_t size,
+                           const uint64_t *channel_shift, uint16_t num_channels);
+
+/**
+ * K-way merge of the channel streams, with a tournament tree. O(n log k) time, n extra timestamps of memory.
+ * The parameters are the same as sort_shifted_channels().
+ */
+void merge_shifted_channels(uint64_t *timestamp, uint16_t *channel, uint64_t size,
+                            const uint64_t *channel_shift, uint16_t num_channels);
+
+/**
+ * Insertion sort of the events, in place. O(n d) time, where d is the number of positions an event has to move.
+ * The parameters are the same as sort_shifted_channels(), the number of channels is not needed.
+ */
+void insertion_sort_shifted_channels(uint64_t *timestamp, uint16_t *channel, uint64_t size,
+                                     const uint64_t *channel_shift);
+
+/**
+ * @brief Sort packed events (see pack_event()) whose timestamps have been shifted by a constant per channel.
+ *
+ * It is the same as sort_shifted_channels(), with the same order of the events, on a single array of packed
+ * events. The channels must be less than #TDCPP_PACKED_MAX_CHANNELS.
+ *
+ * @param events The packed events, with the shifted timestamps. The events of each channel must be sorted.
+ * @param size The number of events.
+ * @param channel_shift The shift that was applied to each channel.
+ * @param num_channels The number of channels, i.e. the size of channel_shift.
+ */
+void sort_shifted_packed_events(uint64_t *events, uint64_t size, const uint64_t *channel_shift,
+                                uint16_t num_channels);
+
+#endif //TDCPP_SORT_H
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cstring>
+#include "TDCpp_stream.h"
+#include "TDCpp_records.h"
+#include "TDCpp_counter.h"
+#include "TDCpp_sort.h"
+#include "TDCpp_metrics.h"
+
+TDCpp_stream::TDCpp_stream(const char *data_file_path, uint16_t clock, uint16_t box_number, uint64_t chunk_size)
+        : TDCpp_stream(clock, box_number, chunk_size) {
+    this->data_file = new TDCpp_mapped_file(data_file_path);
+}
+
+TDCpp_stream::TDCpp_stream(uint16_t clock, uint16_t box_number, uint64_t chunk_size) {
+    this->data_file = nullptr;
+    this->read_index = 0;
+    this->chunk_size = chunk_size > 0 ? chunk_size : 1;
+
+    this->timestamp = nullptr;
+    this->channel = nullptr;
+    this->size = 0;
+    this->carry_size = 0;
+    this->capacity = 0;
+
+    this->clock = clock;
+    this->box_number = box_number;
+    this->num_channels = 8;
+    this->offset = this->offset_buffer.allocate_zeroed(this->num_channels);
+    this->channel_shift = this->channel_shift_buffer.allocate_zeroed(this->num_channels);
+    this->min_channel_shift = 0;
+    this->max_channel_shift = 0;
+
+    if (this->offset == NULL || this->channel_shift == NULL) {
+        log_error_and_exit("Could not allocate the memory to read a file.");
+    }
+
+    this->reserve(this->chunk_size);
+}
+
+TDCpp_stream::~TDCpp_stream() {
+    delete this->data_file;
+}
+
+void TDCpp_stream::reserve(uint64_t new_capacity) {
+    if (new_capacity <= this->capacity) return;
+
+    uint64_t *new_timestamp = this->timestamp_buffer.reallocate(new_capacity);
+    uint16_t *new_channel = this->channel_buffer.reallocate(new_capacity);
+
+    if (new_timestamp == NULL || new_channel == NULL) {
+        log_error_and_exit("Could not allocate the memory to read a file.");
+    }
+
+    this->timestamp = new_timestamp;
+    this->channel = new_channel;
+    this->capacity = new_capacity;
+}
+
+void TDCpp_stream::set_channel_offset(const char *offset_file_path) {
+    if (this->read_index > 0) {
+        log_error_and_exit("The channel offsets must be set before reading the stream.");
+    }
+
+    // Read the offsets and find the maximum negative offset
+    int16_t max_offset = load_channel_offsets(offset_file_path, this->offset, this->num_channels);
+
+    // Same shift as TDCpp_data::set_channel_offset(), so that all the timestamps stay positive.
+    for (uint16_t i = 0; i < this->num_channels; ++i) {
+        this->channel_shift[i] = (uint64_t) (-max_offset + this->offset[i]);
+        if (i == 0 || this->channel_shift[i] < this->min_channel_shift) {
+            this->min_channel_shift = this->channel_shift[i];
+        }
+        if (i == 0 || this->channel_shift[i] > this->max_channel_shift) {
+            this->max_channel_shift = this->channel_shift[i];
+        }
+    }
+}
+
+void TDCpp_stream::start_chunk() {
+    // Move the events that were carried over at the beginning of the arrays.
+    if (this->carry_size > 0 && this->size > 0) {
+        memmove(this->timestamp, this->timestamp + this->size, this->carry_size * sizeof(uint64_t));
+        memmove(this->channel, this->channel + this->size, this->carry_size * sizeof(uint16_t));
+    }
+    this->size = 0;
+}
+
+uint64_t TDCpp_stream::append_records(const char *records, uint64_t n_records) {
+    if (n_records == 0) return this->size;
+
+    uint64_t total_size = this->size + this->carry_size;
+
+    this->reserve(total_size + n_records);
+    deinterleave_records(records, n_records, this->timestamp + total_size, this->channel + total_size);
+    this->read_index += n_records;
+
+    // Any future event has a raw timestamp at least as big as the last one read, therefore
+    // its shifted timestamp is at least this big.
+    uint64_t safe_timestamp = this->timestamp[total_size + n_records - 1] + this->min_channel_shift;
+
+    // Shift the new events, then sort them among the others. The carried events come before the new ones
+    // of the same channel, so each channel is still sorted and can be merged.
+    for (uint64_t i = total_size; i < total_size + n_records; ++i) {
+        this->timestamp[i] += this->channel_shift[this->channel[i]];
+    }
+    if (this->max_channel_shift > this->min_channel_shift) {
+        sort_shifted_channels(this->timestamp, this->channel, total_size + n_records,
+                              this->channel_shift, this->num_channels);
+    }
+    total_size += n_records;
+
+    // The events up to safe_timestamp can not be overtaken anymore, the others are carried over.
+    this->size = (uint64_t) (std::upper_bound(this->timestamp, this->timestamp + total_size, safe_timestamp)
+                             - this->timestamp);
+    this->carry_size = total_size - this->size;
+
+    return this->size;
+}
+
+uint64_t TDCpp_stream::flush_chunk() {
+    // Nothing can overtake the remaining events anymore.
+    this->size += this->carry_size;
+    this->carry_size = 0;
+
+    return this->size;
+}
+
+uint64_t TDCpp_stream::next_chunk() {
+    this->start_chunk();
+
+    while (this->read_index < this->data_file->get_size()) {
+        uint64_t records_to_read = this->data_file->get_size() - this->read_index;
+        if (records_to_read > this->chunk_size) records_to_read = this->chunk_size;
+
+        this->append_records(this->data_file->get_records() + this->read_index * TDCPP_RECORD_SIZE,
+                             records_to_read);
+
+        // These records are not going to be read again.
+        this->data_file->release(this->read_index);
+
+        if (this->size > 0) return this->size;
+    }
+
+    // The file is over.
+    return this->flush_chunk();
+}
+
+void TDCpp_stream::find_n_fold_coincidences(uint16_t n,
+                                           const char *singles_file_name,
+                                           const char *coincidences_file_name,
+                                           uint64_t coincidence_window,
+                                           bool legacyFormat) {
+    TDCpp_stage_timer timer("counting");
+
+    TDCpp_coincidence_counter counter(n, this->num_channels, coincidence_window, legacyFormat);
+
+    // The counter keeps the open window between the chunks.
+    while (this->next_chunk() > 0) {
+        counter.process(this->timestamp, this->channel, this->size);
+    }
+
+    counter.save(singles_file_name, coincidences_file_name);
+
+    // The file is read while counting, this stage includes the loading.
+    timer.stop(this->read_index, TDCPP_HEADER_SIZE + this->read_index * TDCPP_RECORD_SIZE);
+}
@@ -0,0 +1,249 @@
+#ifndef TDCPP_STREAM_H
+#define TDCPP_STREAM_H
+
+#include "TDCpp_data.h"
+#include "TDCpp_mmap.h"
+
+/**
+ * The default number of events per chunk. Around 10MB of arrays.
+ */
+#define TDCPP_STREAM_CHUNK_SIZE 1048576
+
+/**
+ * @brief This class reads a timestamp file from ID800-TDC in fixed-size chunks of events.
+ *
+ * Only one chunk is kept in memory at a time, the pages of the file that have already been read are
+ * released, so that the memory use does not depend on the length of the acquisition.
+ * The channel offsets are applied on the fly: the events whose position could still change because of the
+ * offsets are carried over to the next chunk, so the chunks come out in the same order that
+ * TDCpp_data::set_channel_offset() gives to the whole array.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_stream {
+
+protected:
+    /**
+     * The timestamp file, mapped in memory. It is null when the records are fed by a derived class.
+     */
+    TDCpp_mapped_file *data_file;
+
+    /**
+     * The index of the next record to read, i.e. the number of records read so far.
+     */
+    uint64_t read_index;
+
+    /**
+     * The maximum number of records read from #data_file for each chunk.
+     */
+    uint64_t chunk_size;
+
+    /**
+     * A pointer to the timestamp array of the current chunk.
+     */
+    uint64_t *timestamp;
+
+    /**
+     * A pointer to the channel array of the current chunk.
+     */
+    uint16_t *channel;
+
+    /**
+     * The number of events in the current chunk.
+     */
+    uint64_t size;
+
+    /**
+     * The number of events at the end of #timestamp and #channel that are not part of the current chunk yet.
+     * They are going to be the first events of the next chunk.
+     */
+    uint64_t carry_size;
+
+    /**
+     * The allocated size of #timestamp and #channel.
+     */
+    uint64_t capacity;
+
+    /**
+     * The buffers that own #timestamp and #channel.
+     */
+    TDCpp_buffer<uint64_t> timestamp_buffer;
+    TDCpp_buffer<uint16_t> channel_buffer;
+
+    /**
+     * A pointer to the offset array.
+     */
+    int16_t *offset;
+
+    /**
+     * The shift applied to each channel, i.e. its offset plus the maximum negative offset.
+     */
+    uint64_t *channel_shift;
+
+    /**
+     * The buffers that own #offset and #channel_shift.
+     */
+    TDCpp_buffer<int16_t> offset_buffer;
+    TDCpp_buffer<uint64_t> channel_shift_buffer;
+
+    /**
+     * The minimum of #channel_shift.
+     */
+    uint64_t min_channel_shift;
+
+    /**
+     * The maximum of #channel_shift. If it is equal to #min_channel_shift the events never need sorting.
+     */
+    uint64_t max_channel_shift;
+
+    /**
+     * The number of channels in the object.
+     */
+    uint16_t num_channels;
+
+    /**
+     * The channel that is used as a clock.
+     */
+    uint16_t clock;
+
+    /**
+     * The number of the box from which the data comes from.
+     */
+    uint16_t box_number;
+
+public:
+    /**
+     * This is the default constructor. It opens the file, but it does not read anything yet.
+     * @param data_file_path The path of the timestamp file to be read.
+     * @param clock The channel that is going to be used as clock.
+     * @param box_number The number of the box the data come from.
+     * @param chunk_size The number of records to read for each chunk.
+     */
+    TDCpp_stream(const char *data_file_path, uint16_t clock, uint16_t box_number,
+                 uint64_t chunk_size = TDCPP_STREAM_CHUNK_SIZE);
+
+    /**
+     * This is the default destructor.
+     */
+    virtual ~TDCpp_stream();
+
+    /**
+     * @brief Set an offset per channel. It must be called before the first chunk is read.
+     * @param offset_file_path The name of the offset file.
+     */
+    void set_channel_offset(const char *offset_file_path);
+
+    /**
+     * Read the next chunk of events, replacing the current one.
+     * @return The number of events in the chunk. Zero means that the whole file has been read.
+     */
+    uint64_t next_chunk();
+
+    /**
+     * @return A pointer to the timestamps of the current chunk.
+     */
+    const uint64_t *get_timestamp_array() const {
+        return timestamp;
+    }
+
+    /**
+     * @return A pointer to the channels of the current chunk, from 0 to max_channel-1.
+     */
+    const uint16_t *get_channel_array() const {
+        return channel;
+    }
+
+    /**
+     * @return The number of events in the current chunk.
+     */
+    uint64_t get_size() const {
+        return size;
+    }
+
+    /**
+     * @return The number of channels in the object.
+     */
+    uint16_t get_channels_number() const {
+        return num_channels;
+    }
+
+    /**
+     * @return The channel of the clock
+     */
+    uint16_t get_clock_channel() const {
+        return clock;
+    }
+
+    /**
+     * @return The number of the box
+     */
+    uint16_t get_box_number() const {
+        return box_number;
+    }
+
+    /**
+     * @brief This method finds n-fold coincidences in the whole file, one chunk at a time.
+     * The result is the same as TDCpp_data::find_n_fold_coincidences(), the coincidence windows that span
+     * two chunks are handled correctly.
+     * @param n The *exact* number of events that must occur at the same time (modulo coincidence_window).
+     * @param singles_file_name The name of the file in which the single events count will be saved.
+     * @param coincidences_file_name The name of the file in which the coincidence events will be saved.
+     * @param coincidence_window The maximum time distance *in bins* in which two
+     *      or more events are considered coincident.
+     * @param legacyFormat Use and alternative printing standard, for compatibility.
+     */
+    void find_n_fold_coincidences(uint16_t n,
+                                  const char *singles_file_name,
+                                  const char *coincidences_file_name,
+                                  uint64_t coincidence_window,
+                                  bool legacyFormat = false);
+
+protected:
+    /**
+     * This constructor does not open any file, the records are fed by the derived class with append_records().
+     * @param clock The channel that is going to be used as clock.
+     * @param box_number The number of the box the data come from.
+     * @param chunk_size The number of records to read for each chunk.
+     */
+    TDCpp_stream(uint16_t clock, uint16_t box_number, uint64_t chunk_size);
+
+    /**
+     * Drop the current chunk, keeping the events that were carried over. It must be called before
+     * append_records() to start a new chunk.
+     */
+    void start_chunk();
+
+    /**
+     * Add packed records to the current chunk, applying the channel offsets. Only the events that can not be
+     * overtaken by the next records become part of the chunk, the others are carried over.
+     * @param records A pointer to the first packed record.
+     * @param n_records The number of records, they must come after all the ones already appended.
+     * @return The number of events in the chunk.
+     */
+    uint64_t append_records(const char *records, uint64_t n_records);
+
+    /**
+     * Make all the carried events part of the current chunk, when no more records are coming.
+     * @return The number of events in the chunk.
+     */
+    uint64_t flush_chunk();
+
+private:
+    /**
+     * Make sure that #timestamp and #channel can hold at least new_capacity events.
+     * @param new_capacity The number of events.
+     */
+    void reserve(uint64_t new_capacity);
+
+    /**
+     * Deleted copy constructor.
+     */
+    TDCpp_stream(const TDCpp_stream &) = delete;
+
+    /**
+     * Deleted assignment operator.
+     */
+    TDCpp_stream &operator=(const TDCpp_stream &) = delete;
+};
+
+#endif //TDCPP_STREAM_H
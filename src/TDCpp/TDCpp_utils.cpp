@@ -1,10 +1,19 @@
 #include <iostream>
 #include <thread>
 #include <cstring>
+#include <cinttypes>
+#include <exception>
+#include <vector>
 #include "TDCpp_utils.h"
 
 #define NUM_THREADS 8
 
+static bool error_exceptions = false;
+
+void set_error_exceptions(bool enable) {
+    error_exceptions = enable;
+}
+
 void log_error_and_exit(const char *error_message) {
     std::cerr << "Fatal error: " << error_message << std::endl;
     FILE* logFile = fopen("error.log", "a+");
@@ -21,6 +30,12 @@ void log_error_and_exit(const char *error_message) {
         strftime(timeString, sizeof(timeString), "%c", time_info);
         // Print error and timestamp
         fprintf(logFile, "%s::Fatal error::%s\n", timeString, error_message);
+        fclose(logFile);
+    }
+
+    // A resident process reports the error to its caller and keeps running.
+    if (error_exceptions) {
+        throw TDCpp_error(error_message);
     }
 
     FILE *error_file = fopen("error.task", "w");
@@ -40,6 +55,96 @@ uint64_t custom_ratio(uint64_t x, uint64_t y) {
     return y/x;
 }
 
+char *format_u64(char *destination, uint64_t value) {
+    // The digits of 00 to 99, so that two digits are written with each division.
+    static const char digit_pairs[201] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+    // Write the digits from the end of a local buffer, then copy them in place.
+    char digits[20];
+    char *position = digits + sizeof(digits);
+    while (value >= 100) {
+        uint64_t pair = (value % 100) * 2;
+        value /= 100;
+        position -= 2;
+        position[0] = digit_pairs[pair];
+        position[1] = digit_pairs[pair + 1];
+    }
+    if (value >= 10) {
+        position -= 2;
+        position[0] = digit_pairs[value * 2];
+        position[1] = digit_pairs[value * 2 + 1];
+    } else {
+        *--position = (char) ('0' + value);
+    }
+
+    size_t length = (size_t) (digits + sizeof(digits) - position);
+    memcpy(destination, position, length);
+    return destination + length;
+}
+
+int16_t load_channel_offsets(const char *offset_file_path, int16_t *offset, uint16_t num_channels) {
+    FILE *offset_file = fopen(offset_file_path, "r");
+    int16_t max_offset = 0;
+
+    if (offset_file) {
+        // Find the maximum negative offset
+        for (uint16_t i = 0; i < num_channels; ++i) {
+            fscanf(offset_file, "%" SCNd16 "", offset + i);
+            if (max_offset > offset[i]) max_offset = offset[i];
+        }
+
+        fclose(offset_file);
+    } else {
+        std::string error_string("Can't read offset file  ");
+        error_string.append(offset_file_path);
+        log_error_and_exit(error_string.c_str());
+    }
+
+    return max_offset;
+}
+
+std::string window_file_name(const char *file_name, uint64_t value) {
+    std::string name(file_name);
+    std::string suffix = "_" + std::to_string(value);
+
+    // Only a dot after the last slash starts an extension.
+    size_t dot_position = name.find_last_of('.');
+    size_t slash_position = name.find_last_of('/');
+    if (dot_position == std::string::npos || dot_position == 0 ||
+        (slash_position != std::string::npos && dot_position < slash_position)) {
+        return name + suffix;
+    }
+
+    return name.insert(dot_position, suffix);
+}
+
+void run_tasks(uint64_t num_tasks, const std::function<void(uint64_t)> &task) {
+    std::vector<std::exception_ptr> errors(num_tasks);
+    auto run_task = [&task, &errors](uint64_t t) {
+        try {
+            task(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint64_t t = 1; t < num_tasks; ++t) {
+        threads.push_back(std::thread(run_task, t));
+    }
+    if (num_tasks > 0) run_task(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto &error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
 void u64_vectorize_function(uint64_t *array, uint64_t arraySize, std::function<uint64_t (uint64_t)> func) {
     std::thread threads[NUM_THREADS];
     uint64_t blk_size = arraySize/NUM_THREADS;
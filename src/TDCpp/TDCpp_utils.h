@@ -3,13 +3,70 @@
 
 #include <ctime>
 #include <functional>
+#include <stdexcept>
+#include <string>
 
+/**
+ * The error thrown by log_error_and_exit() when set_error_exceptions() is enabled.
+ */
+class TDCpp_error : public std::runtime_error {
+public:
+    explicit TDCpp_error(const char *error_message) : std::runtime_error(error_message) {
+    }
+};
+
+/**
+ * Log the error, create error.task and exit. When set_error_exceptions() is enabled, throw a TDCpp_error instead
+ * of creating error.task and exiting.
+ * @param error_message The description of the error.
+ */
 void log_error_and_exit(const char *error_message);
 
+/**
+ * Choose how log_error_and_exit() ends, e.g. a resident process must report the errors and keep running.
+ * The memory held by the object that failed is not always released, the object must not be used anymore.
+ * @param enable True to throw a TDCpp_error, false to exit the process.
+ */
+void set_error_exceptions(bool enable);
+
 uint64_t abs_diff_64(uint64_t x, uint64_t y);
 
 uint64_t custom_ratio(uint64_t x, uint64_t y);
 
+/**
+ * Read one offset per channel from an offset file.
+ * @param offset_file_path The name of the offset file.
+ * @param offset The destination array, it must hold num_channels elements.
+ * @param num_channels The number of offsets to read.
+ * @return The maximum negative offset, or zero if all the offsets are positive.
+ */
+int16_t load_channel_offsets(const char *offset_file_path, int16_t *offset, uint16_t num_channels);
+
+/**
+ * Append a value to a file name, before the extension. E.g. singles.temp and 25 give singles_25.temp.
+ * @param file_name The file name.
+ * @param value The value to append.
+ * @return The new file name.
+ */
+std::string window_file_name(const char *file_name, uint64_t value);
+
+/**
+ * Write the decimal representation of a number, as printf's PRIu64 would, without the terminating null.
+ * @param destination Where to write the digits. It must hold at least 20 characters.
+ * @param value The number to write.
+ * @return A pointer to the character after the last digit.
+ */
+char *format_u64(char *destination, uint64_t value);
+
+/**
+ * Run the tasks 0 to num_tasks - 1 at the same time, the first one on the calling thread and each other one on
+ * its own thread, and wait for all of them. An exception thrown by a task, e.g. a TDCpp_error, would terminate
+ * the process if it escaped its thread, so it is rethrown here once all the tasks are done.
+ * @param num_tasks The number of tasks.
+ * @param task The function that runs a task, given its number.
+ */
+void run_tasks(uint64_t num_tasks, const std::function<void(uint64_t)> &task);
+
 void u64_vectorize_function(uint64_t* array, uint64_t arraySize, std::function<uint64_t (uint64_t)> func);
 
 void u64_apply_function(uint64_t* array, uint64_t start_index, uint64_t end_index, std::function<uint64_t (uint64_t)> func);
@@ -0,0 +1,19 @@
+#include "TDCpp_view.h"
+
+TDCpp_view::TDCpp_view(TDCpp_data &data, uint64_t start_time, uint64_t end_time) {
+    this->start_index = data.find_time_index(start_time);
+    uint64_t end_index = end_time > start_time ? data.find_time_index(end_time) : this->start_index;
+
+    this->timestamp = data.timestamp + this->start_index;
+    this->channel = data.channel + this->start_index;
+    this->size = end_index - this->start_index;
+
+    this->offset = data.offset;
+    this->num_channels = data.num_channels;
+    this->clock = data.clock;
+    this->box_number = data.box_number;
+}
+
+TDCpp_view::~TDCpp_view() {
+    // The arrays belong to the original object, the buffers of the view are empty.
+}
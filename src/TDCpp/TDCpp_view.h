@@ -0,0 +1,44 @@
+#ifndef TDCPP_VIEW_H
+#define TDCPP_VIEW_H
+
+#include "TDCpp_data.h"
+
+/**
+ * @brief This class gives access to the events of a TDCpp_data object within a time range, without copying them.
+ *
+ * A view shares the arrays of the object it comes from, so every analysis of TDCpp_data, e.g.
+ * find_n_fold_coincidences(), runs on the range only. The object must outlive the view, and the view must be
+ * treated as read only: set_channel_offset() would change the events of the object as well.
+ *
+ * Created on: Oct 16 2026
+ */
+class TDCpp_view : public TDCpp_data {
+protected:
+    /**
+     * The index, in the original object, of the first event of the view.
+     */
+    uint64_t start_index;
+
+public:
+    /**
+     * This is the default constructor.
+     * @param data The object the events come from. Its timestamps must be sorted.
+     * @param start_time The beginning of the range, in bins. Included.
+     * @param end_time The end of the range, in bins. Excluded.
+     */
+    TDCpp_view(TDCpp_data &data, uint64_t start_time, uint64_t end_time);
+
+    /**
+     * This is the default destructor. The arrays are left to the original object.
+     */
+    virtual ~TDCpp_view();
+
+    /**
+     * @return The index, in the original object, of the first event of the view.
+     */
+    uint64_t get_start_index() const {
+        return start_index;
+    }
+};
+
+#endif //TDCPP_VIEW_H
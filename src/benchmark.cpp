@@ -0,0 +1,748 @@
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <cinttypes>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "TDCpp/TDCpp_buffer.h"
+#include "TDCpp/TDCpp_data.h"
+#include "TDCpp/TDCpp_merger.h"
+#include "TDCpp/TDCpp_packed.h"
+#include "TDCpp/TDCpp_view.h"
+#include "TDCpp/TDCpp_generator.h"
+#include "TDCpp/TDCpp_records.h"
+#include "TDCpp/TDCpp_sort.h"
+#include "TDCpp/TDCpp_drift.h"
+
+/**
+ * The number of synthetic records used by the benchmarks. 80MB of packed records.
+ */
+#define BENCHMARK_RECORDS 8000000
+
+/**
+ * Each benchmark is repeated this many times, the best time is reported.
+ */
+#define BENCHMARK_REPETITIONS 5
+
+/**
+ * The number of synthetic events used by the offset benchmarks.
+ */
+#define BENCHMARK_EVENTS 4000000
+
+/**
+ * The directory in which the pipeline benchmarks write their files. It is removed at the end.
+ */
+#define BENCHMARK_DIRECTORY "benchmark_files"
+
+/**
+ * The number of boxes of the pipeline benchmarks.
+ */
+#define BENCHMARK_BOXES 3
+
+/**
+ * The number of timestamps of the buffer benchmarks. 256MB, many times the reach of the TLB with 4kB pages.
+ */
+#define BENCHMARK_BUFFER_EVENTS 32000000
+
+/**
+ * A TDCpp_data object filled with synthetic events instead of a file.
+ */
+class benchmark_data : public TDCpp_data {
+public:
+    /**
+     * Fill the object with Poisson-like events on 8 channels.
+     * @param n_events The number of events.
+     * @param mean_spacing The mean time between two events, in bins.
+     */
+    benchmark_data(uint64_t n_events, uint64_t mean_spacing) {
+        this->size = n_events;
+        this->num_channels = 8;
+        this->clock = 8;
+        this->box_number = 1;
+        this->timestamp = this->timestamp_buffer.allocate(n_events);
+        this->channel = this->channel_buffer.allocate(n_events);
+        this->offset = this->offset_buffer.allocate_zeroed(this->num_channels);
+
+        uint64_t current_timestamp = 0;
+        srand(7);
+        for (uint64_t i = 0; i < n_events; ++i) {
+            current_timestamp += (uint64_t) (rand() % (2 * mean_spacing));
+            this->timestamp[i] = current_timestamp;
+            this->channel[i] = (uint16_t) (rand() % this->num_channels);
+        }
+    }
+
+    /**
+     * Copy the events of another object.
+     * @param data The object the events come from.
+     * @param begin The index of the first event that is copied.
+     * @param end The index after the last event that is copied.
+     */
+    benchmark_data(const TDCpp_data &data, uint64_t begin, uint64_t end) {
+        this->size = end - begin;
+        this->num_channels = data.get_channels_number();
+        this->clock = data.get_clock_channel();
+        this->box_number = 1;
+        this->timestamp = this->timestamp_buffer.allocate(this->size);
+        this->channel = this->channel_buffer.allocate(this->size);
+        this->offset = this->offset_buffer.allocate_zeroed(this->num_channels);
+        memcpy(this->timestamp, data.get_timestamp_array() + begin, this->size * sizeof(uint64_t));
+        memcpy(this->channel, data.get_channel_array() + begin, this->size * sizeof(uint16_t));
+    }
+
+    /**
+     * The insertion sort that set_channel_offset() used before the k-way merge, kept as a reference.
+     */
+    void insertion_sort_channel_offset(const int16_t *channel_offset) {
+        int16_t max_offset = 0;
+        for (uint16_t i = 0; i < this->num_channels; ++i) {
+            if (max_offset > channel_offset[i]) max_offset = channel_offset[i];
+        }
+
+        for (uint64_t i = 0; i < this->size; ++i) {
+            uint64_t sorting_timestamp = this->timestamp[i] + (uint64_t) (-max_offset + channel_offset[this->channel[i]]);
+            uint16_t sorting_channel = this->channel[i];
+            uint64_t j = i;
+            while (j > 0 && this->timestamp[j - 1] > sorting_timestamp) {
+                this->timestamp[j] = this->timestamp[j - 1];
+                this->channel[j] = this->channel[j - 1];
+                j--;
+            }
+            this->timestamp[j] = sorting_timestamp;
+            this->channel[j] = sorting_channel;
+        }
+    }
+
+    /**
+     * Apply the offsets and always use the k-way merge, whatever set_channel_offset() would choose.
+     */
+    void merge_channel_offset(const int16_t *channel_offset) {
+        int16_t max_offset = 0;
+        for (uint16_t i = 0; i < this->num_channels; ++i) {
+            if (max_offset > channel_offset[i]) max_offset = channel_offset[i];
+        }
+
+        uint64_t channel_shift[8];
+        for (uint16_t i = 0; i < this->num_channels; ++i) {
+            channel_shift[i] = (uint64_t) (-max_offset + channel_offset[i]);
+        }
+        for (uint64_t i = 0; i < this->size; ++i) {
+            this->timestamp[i] += channel_shift[this->channel[i]];
+        }
+
+        merge_shifted_channels(this->timestamp, this->channel, this->size, channel_shift, this->num_channels);
+    }
+
+    /**
+     * @return True if the timestamps of the two objects are equal.
+     */
+    bool has_same_timestamps(const benchmark_data &other) const {
+        return this->size == other.size &&
+               memcmp(this->timestamp, other.timestamp, this->size * sizeof(uint64_t)) == 0;
+    }
+};
+
+/**
+ * Time the old insertion sort, the k-way merge and set_channel_offset() (which picks the fastest of the two)
+ * and print their throughput, in millions of events per second.
+ */
+void benchmark_channel_offset(const char *name, const int16_t *channel_offset, uint64_t mean_spacing) {
+    benchmark_data insertion_data(BENCHMARK_EVENTS, mean_spacing);
+    benchmark_data merge_data(BENCHMARK_EVENTS, mean_spacing);
+    benchmark_data offset_data(BENCHMARK_EVENTS, mean_spacing);
+
+    auto start = std::chrono::steady_clock::now();
+    insertion_data.insertion_sort_channel_offset(channel_offset);
+    std::chrono::duration<double> insertion_seconds = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    merge_data.merge_channel_offset(channel_offset);
+    std::chrono::duration<double> merge_seconds = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    offset_data.set_channel_offset(channel_offset);
+    std::chrono::duration<double> offset_seconds = std::chrono::steady_clock::now() - start;
+
+    printf("channel offset %-14s insertion sort %8.2f, k-way merge %8.2f, set_channel_offset %8.2f Mevents/s %s\n",
+           name, BENCHMARK_EVENTS / insertion_seconds.count() / 1E6, BENCHMARK_EVENTS / merge_seconds.count() / 1E6,
+           BENCHMARK_EVENTS / offset_seconds.count() / 1E6,
+           merge_data.has_same_timestamps(insertion_data) && offset_data.has_same_timestamps(insertion_data)
+           ? "" : "(WRONG RESULT)");
+}
+
+typedef void (*deinterleave_kernel)(const char *, uint64_t, uint64_t *, uint16_t *);
+
+/**
+ * Time a deinterleave kernel and print its throughput, in GB/s of packed records.
+ */
+void benchmark_deinterleave(const char *name, deinterleave_kernel kernel, const char *records, uint64_t n_records,
+                            const uint64_t *expected_timestamp, const uint16_t *expected_channel) {
+    uint64_t *timestamp = (uint64_t *) malloc(n_records * sizeof(uint64_t));
+    uint16_t *channel = (uint16_t *) malloc(n_records * sizeof(uint16_t));
+
+    double best_seconds = 0;
+    for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; ++repetition) {
+        auto start = std::chrono::steady_clock::now();
+        kernel(records, n_records, timestamp, channel);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (repetition == 0 || elapsed.count() < best_seconds) best_seconds = elapsed.count();
+    }
+
+    bool is_correct = memcmp(timestamp, expected_timestamp, n_records * sizeof(uint64_t)) == 0 &&
+                      memcmp(channel, expected_channel, n_records * sizeof(uint16_t)) == 0;
+
+    printf("deinterleave %-8s %8.3f GB/s %s\n", name,
+           (double) n_records * TDCPP_RECORD_SIZE / best_seconds / 1E9, is_correct ? "" : "(WRONG RESULT)");
+
+    free(timestamp);
+    free(channel);
+}
+
+/**
+ * The drift correction of the merger before the fixed-point kernels, kept as a reference.
+ */
+void double_correct_drift(const uint64_t *timestamp, uint64_t size, uint64_t *destination,
+                          uint64_t knot, uint64_t reference_knot, int64_t correction, uint64_t limit) {
+    double correction_factor = (double) correction / (double) (1ULL << TDCPP_DRIFT_FRACTION_BITS);
+    for (uint64_t i = 0; i < size; ++i) {
+        uint64_t elapsed = timestamp[i] - knot;
+        uint64_t corrected = reference_knot + elapsed + (int64_t) trunc((double) elapsed * correction_factor);
+        destination[i] = corrected < limit ? corrected : limit;
+    }
+}
+
+typedef void (*correct_drift_function)(const uint64_t *, uint64_t, uint64_t *, uint64_t, uint64_t, int64_t, uint64_t);
+
+/**
+ * Time a drift correction kernel on num_threads threads and print its throughput, in millions of events per
+ * second, as well as the largest difference from the floating point version.
+ */
+void benchmark_drift(const char *name, correct_drift_function kernel, uint16_t num_threads,
+                     const uint64_t *timestamp, uint64_t size, int64_t correction, const uint64_t *expected) {
+    uint64_t *destination = (uint64_t *) malloc(size * sizeof(uint64_t));
+    const uint64_t slice_size = (size + num_threads - 1) / num_threads;
+
+    double best_seconds = 0;
+    for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; ++repetition) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (uint64_t first = 0; first < size; first += slice_size) {
+            uint64_t slice = size - first < slice_size ? size - first : slice_size;
+            threads.push_back(std::thread(kernel, timestamp + first, slice, destination + first,
+                                          timestamp[0], (uint64_t) 0, correction, TDCPP_DRIFT_NO_LIMIT));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (repetition == 0 || elapsed.count() < best_seconds) best_seconds = elapsed.count();
+    }
+
+    uint64_t max_error = 0;
+    for (uint64_t i = 0; i < size; ++i) {
+        uint64_t error = destination[i] > expected[i] ? destination[i] - expected[i] : expected[i] - destination[i];
+        if (error > max_error) max_error = error;
+    }
+
+    printf("drift correction %-8s %2" PRIu16 " threads %8.2f Mevents/s, max error %" PRIu64 " bins\n",
+           name, num_threads, size / best_seconds / 1E6, max_error);
+
+    free(destination);
+}
+
+/**
+ * @return The seconds since start.
+ */
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/**
+ * Write synthetic timestamp files for #BENCHMARK_BOXES boxes in #BENCHMARK_DIRECTORY, which is created.
+ * @param duration The length of the acquisition, in seconds.
+ * @param singles_rate The rate of the single events on each channel, in Hz.
+ * @return The names of the files, one per box.
+ */
+static std::vector<std::string> write_benchmark_files(double duration, double singles_rate) {
+    mkdir(BENCHMARK_DIRECTORY, 0755);
+
+    // Correlated pairs at a tenth of the singles rate, boxes with a few ppm of drift and starting 10ms apart.
+    TDCpp_generator generator(BENCHMARK_BOXES, duration);
+    generator.set_singles_rate(singles_rate);
+    generator.set_coincidences(2, singles_rate / 10, 100E-12);
+
+    std::vector<std::string> file_names;
+    for (uint16_t i = 0; i < BENCHMARK_BOXES; ++i) {
+        generator.set_drift(i, (i % 2 == 0 ? 2E-6 : -3E-6) * i);
+        generator.set_start_delay(i, 0.01 * i);
+        file_names.push_back(std::string(BENCHMARK_DIRECTORY "/timestamps") + std::to_string(i + 1) + ".txt");
+        generator.write_file(i, file_names.back().c_str());
+    }
+    return file_names;
+}
+
+/**
+ * Write synthetic files for #BENCHMARK_BOXES boxes, then time each stage of the two-fold analysis on them:
+ * loading, matching and merging, applying the offsets and counting the coincidences. The throughput of each
+ * stage is printed in millions of events per second.
+ * @param duration The length of the acquisition, in seconds.
+ * @param singles_rate The rate of the single events on each channel, in Hz.
+ * @param num_threads The number of threads of the stages that can use them.
+ */
+void benchmark_pipeline(double duration, double singles_rate, uint16_t num_threads) {
+    std::vector<std::string> file_names = write_benchmark_files(duration, singles_rate);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<TDCpp_data *> boxes;
+    uint64_t box_events = 0;
+    for (uint16_t i = 0; i < BENCHMARK_BOXES; ++i) {
+        boxes.push_back(new TDCpp_data());
+        boxes.back()->load_from_file(file_names[i].c_str(), 8, (uint16_t) (i + 1));
+        box_events += boxes.back()->get_size();
+    }
+    double load_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    TDCpp_merger *merged = new TDCpp_merger(boxes, num_threads);
+    double merge_seconds = seconds_since(start);
+
+    for (TDCpp_data *box : boxes) {
+        delete box;
+    }
+
+    // The same offsets for every box.
+    const int16_t box_offset[8] = {0, -40, 25, 3, 0, -7, 100, 0};
+    std::vector<int16_t> channel_offset(merged->get_channels_number());
+    for (uint64_t i = 0; i < channel_offset.size(); ++i) {
+        channel_offset[i] = box_offset[i % 8];
+    }
+
+    start = std::chrono::steady_clock::now();
+    merged->set_channel_offset(channel_offset.data());
+    double offset_seconds = seconds_since(start);
+
+    const std::string singles_file_name(BENCHMARK_DIRECTORY "/singles.temp");
+    const std::string coincidences_file_name(BENCHMARK_DIRECTORY "/coincidences.temp");
+    start = std::chrono::steady_clock::now();
+    merged->find_n_fold_coincidences(2, singles_file_name.c_str(), coincidences_file_name.c_str(), 25, false,
+                                     num_threads);
+    double coincidences_seconds = seconds_since(start);
+
+    const uint64_t merged_events = merged->get_size();
+    printf("pipeline %5.1f s %7.0f Hz/channel %10" PRIu64 " events: load %7.2f, merge %7.2f, offset %7.2f, "
+           "coincidences %7.2f Mevents/s\n", duration, singles_rate, box_events,
+           box_events / load_seconds / 1E6, box_events / merge_seconds / 1E6,
+           merged_events / offset_seconds / 1E6, merged_events / coincidences_seconds / 1E6);
+
+    delete merged;
+
+    for (const std::string &file_name : file_names) {
+        unlink(file_name.c_str());
+    }
+    unlink(singles_file_name.c_str());
+    unlink(coincidences_file_name.c_str());
+    rmdir(BENCHMARK_DIRECTORY);
+}
+
+/**
+ * @return The number of minor page faults of the process so far.
+ */
+static uint64_t get_minor_faults() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (uint64_t) usage.ru_minflt;
+}
+
+/**
+ * Open a counter of the data TLB read misses of this thread.
+ * @return The counter, or -1 if the kernel or the hardware does not provide it.
+ */
+static int open_dtlb_counter() {
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HW_CACHE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+/**
+ * Time a sequential scan and a random gather over an array of timestamps, as the counting and the matching do.
+ * @param name The name of the allocator.
+ * @param timestamp The array, not initialized yet.
+ * @param size The number of timestamps.
+ * @param allocated_bytes The number of bytes actually reserved for the array.
+ */
+static void benchmark_timestamp_array(const char *name, uint64_t *timestamp, uint64_t size,
+                                      uint64_t allocated_bytes) {
+    uint64_t faults = get_minor_faults();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < size; ++i) {
+        timestamp[i] = i * 1000;
+    }
+    double fill_seconds = seconds_since(start);
+    faults = get_minor_faults() - faults;
+
+    int dtlb_counter = open_dtlb_counter();
+    if (dtlb_counter >= 0) {
+        ioctl(dtlb_counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(dtlb_counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t sum = 0;
+    double scan_seconds = 1E9;
+    for (uint16_t repetition = 0; repetition < BENCHMARK_REPETITIONS; ++repetition) {
+        start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < size; ++i) {
+            sum += timestamp[i];
+        }
+        scan_seconds = std::min(scan_seconds, seconds_since(start));
+    }
+
+    // A multiplicative sequence, so that each access is far from the previous one.
+    const uint64_t n_gathers = size / 4;
+    uint64_t index = 1;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < n_gathers; ++i) {
+        index = (index * 6364136223846793005ULL + 1442695040888963407ULL);
+        sum += timestamp[(index >> 16) % size];
+    }
+    double gather_seconds = seconds_since(start);
+
+    uint64_t dtlb_misses = 0;
+    if (dtlb_counter >= 0) {
+        ioctl(dtlb_counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(dtlb_counter, &dtlb_misses, sizeof(dtlb_misses)) != sizeof(dtlb_misses)) dtlb_misses = 0;
+        close(dtlb_counter);
+    }
+
+    std::string dtlb_text = dtlb_counter >= 0 ? std::to_string(dtlb_misses) : std::string("n/a");
+    printf("buffer %-8s fill %7.1f ms, %8" PRIu64 " faults, scan %7.1f Mevents/s, gather %6.1f Mevents/s, "
+           "dTLB misses %12s, waste %8" PRIu64 " bytes\n", name, fill_seconds * 1E3, faults,
+           size / scan_seconds / 1E6, n_gathers / gather_seconds / 1E6, dtlb_text.c_str(),
+           allocated_bytes > size * sizeof(uint64_t) ? allocated_bytes - size * sizeof(uint64_t) : 0);
+
+    // Keep the sum, so that the loops are not optimized away.
+    volatile uint64_t kept_sum = sum;
+    (void) kept_sum;
+}
+
+/**
+ * Compare the arrays from malloc() with the ones of TDCpp_buffer, backed by huge pages: the page faults of the
+ * first write, the throughput of the scans and the gathers, the data TLB misses and the memory wasted by the
+ * rounding to whole huge pages.
+ */
+void benchmark_buffers() {
+    const uint64_t size = BENCHMARK_BUFFER_EVENTS;
+
+    uint64_t *malloc_timestamp = (uint64_t *) malloc(size * sizeof(uint64_t));
+    if (malloc_timestamp == NULL) {
+        log_error_and_exit("Could not allocate the memory for the benchmark.");
+    }
+    benchmark_timestamp_array("malloc", malloc_timestamp, size, size * sizeof(uint64_t));
+    free(malloc_timestamp);
+
+    TDCpp_buffer<uint64_t> buffer;
+    if (buffer.allocate(size) == nullptr) {
+        log_error_and_exit("Could not allocate the memory for the benchmark.");
+    }
+    benchmark_timestamp_array("buffer", buffer.data(), size, buffer.get_allocated_bytes());
+}
+
+/**
+ * @return The content of a file, empty if it can not be read.
+ */
+static std::string read_whole_file(const std::string &file_name) {
+    std::ifstream file(file_name.c_str());
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+/**
+ * Apply the offsets and count the two-fold coincidences on the same synthetic events, once as TDCpp_data and once
+ * packed, and print the throughput and the memory of each layout.
+ * @param name The name of the case.
+ * @param channel_offset The offset of each of the 8 channels.
+ * @param mean_spacing The mean time between two events, in bins.
+ */
+void benchmark_packed(const char *name, const int16_t *channel_offset, uint64_t mean_spacing) {
+    mkdir(BENCHMARK_DIRECTORY, 0755);
+    const uint64_t coincidence_window = mean_spacing / 40;
+
+    benchmark_data data(BENCHMARK_EVENTS, mean_spacing);
+    TDCpp_packed packed(data);
+
+    auto start = std::chrono::steady_clock::now();
+    data.set_channel_offset(channel_offset);
+    double data_offset_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    packed.set_channel_offset(channel_offset);
+    double packed_offset_seconds = seconds_since(start);
+
+    const std::string file_prefix(BENCHMARK_DIRECTORY "/");
+    start = std::chrono::steady_clock::now();
+    data.find_n_fold_coincidences(2, (file_prefix + "data_singles.temp").c_str(),
+                                  (file_prefix + "data_coincidences.temp").c_str(), coincidence_window);
+    double data_counting_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    packed.find_n_fold_coincidences(2, (file_prefix + "packed_singles.temp").c_str(),
+                                    (file_prefix + "packed_coincidences.temp").c_str(), coincidence_window);
+    double packed_counting_seconds = seconds_since(start);
+
+    bool is_same = data.get_size() == packed.get_size();
+    for (uint64_t i = 0; is_same && i < data.get_size(); ++i) {
+        is_same = data.get_timestamp(i) == packed.get_timestamp(i) && data.get_channel(i) == packed.get_channel(i);
+    }
+    const char *count_files[] = {"singles.temp", "coincidences.temp"};
+    for (const char *count_file : count_files) {
+        std::string data_file_name = file_prefix + "data_" + count_file;
+        std::string packed_file_name = file_prefix + "packed_" + count_file;
+        is_same = is_same && read_whole_file(data_file_name) == read_whole_file(packed_file_name);
+        unlink(data_file_name.c_str());
+        unlink(packed_file_name.c_str());
+    }
+    rmdir(BENCHMARK_DIRECTORY);
+
+    printf("packed %-14s offsets %8.2f -> %8.2f, counting %8.2f -> %8.2f Mevents/s, %d -> %d bytes/event %s\n",
+           name, BENCHMARK_EVENTS / data_offset_seconds / 1E6, BENCHMARK_EVENTS / packed_offset_seconds / 1E6,
+           BENCHMARK_EVENTS / data_counting_seconds / 1E6, BENCHMARK_EVENTS / packed_counting_seconds / 1E6,
+           TDCPP_TIMESTAMP_SIZE + TDCPP_CHANNEL_SIZE, (int) sizeof(uint64_t), is_same ? "" : "(WRONG RESULT)");
+}
+
+/**
+ * Take the middle half of synthetic events in time, once as a TDCpp_view and once as a copy, and count the
+ * two-fold coincidences on both. Print the time taken by each to get the events and whether the counts are the same.
+ * @param mean_spacing The mean time between two events, in bins.
+ */
+void benchmark_view(uint64_t mean_spacing) {
+    mkdir(BENCHMARK_DIRECTORY, 0755);
+    const uint64_t coincidence_window = mean_spacing / 40;
+
+    benchmark_data data(BENCHMARK_EVENTS, mean_spacing);
+    const uint64_t start_time = data.get_timestamp(BENCHMARK_EVENTS - 1) / 4;
+    const uint64_t end_time = 3 * start_time;
+    // Build the time index beforehand, both sides use it.
+    data.find_time_index(start_time);
+
+    auto start = std::chrono::steady_clock::now();
+    TDCpp_view view(data, start_time, end_time);
+    double view_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    benchmark_data slice(data, data.find_time_index(start_time), data.find_time_index(end_time));
+    double slice_seconds = seconds_since(start);
+
+    const std::string file_prefix(BENCHMARK_DIRECTORY "/");
+    view.find_n_fold_coincidences(2, (file_prefix + "view_singles.temp").c_str(),
+                                  (file_prefix + "view_coincidences.temp").c_str(), coincidence_window);
+    slice.find_n_fold_coincidences(2, (file_prefix + "slice_singles.temp").c_str(),
+                                   (file_prefix + "slice_coincidences.temp").c_str(), coincidence_window);
+
+    bool is_same = view.get_size() == slice.get_size();
+    const char *count_files[] = {"singles.temp", "coincidences.temp"};
+    for (const char *count_file : count_files) {
+        std::string view_file_name = file_prefix + "view_" + count_file;
+        std::string slice_file_name = file_prefix + "slice_" + count_file;
+        is_same = is_same && read_whole_file(view_file_name) == read_whole_file(slice_file_name);
+        unlink(view_file_name.c_str());
+        unlink(slice_file_name.c_str());
+    }
+    rmdir(BENCHMARK_DIRECTORY);
+
+    printf("view   %10" PRIu64 " events: copy %8.3f ms -> view %8.3f ms %s\n", slice.get_size(),
+           slice_seconds * 1E3, view_seconds * 1E3, is_same ? "" : "(WRONG RESULT)");
+}
+
+/**
+ * Write synthetic files for #BENCHMARK_BOXES boxes, then load and merge them once as TDCpp_data, with
+ * load_from_mapped_file() and TDCpp_merger, and once straight into the packed layout, with
+ * TDCpp_packed::load_from_file() and the merging constructor of TDCpp_packed. Print the throughput of each, in
+ * millions of events per second, and check that both give the same events.
+ * @param duration The length of the acquisition, in seconds.
+ * @param singles_rate The rate of the single events on each channel, in Hz.
+ * @param num_threads The number of threads of the merges.
+ */
+void benchmark_packed_loading(double duration, double singles_rate, uint16_t num_threads) {
+    std::vector<std::string> file_names = write_benchmark_files(duration, singles_rate);
+
+    bool is_same = true;
+    std::vector<TDCpp_data *> boxes;
+    uint64_t box_events = 0;
+    double data_load_seconds = 0, packed_load_seconds = 0;
+    for (uint16_t i = 0; i < BENCHMARK_BOXES; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        boxes.push_back(new TDCpp_data());
+        boxes.back()->load_from_mapped_file(file_names[i].c_str(), 8, (uint16_t) (i + 1));
+        data_load_seconds += seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        TDCpp_packed packed_box;
+        packed_box.load_from_file(file_names[i].c_str(), 8, (uint16_t) (i + 1));
+        packed_load_seconds += seconds_since(start);
+
+        is_same = is_same && packed_box.get_size() == boxes.back()->get_size();
+        for (uint64_t j = 0; is_same && j < packed_box.get_size(); ++j) {
+            is_same = packed_box.get_timestamp(j) == boxes.back()->get_timestamp(j) &&
+                      packed_box.get_channel(j) == boxes.back()->get_channel(j);
+        }
+        box_events += boxes.back()->get_size();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TDCpp_merger *merged = new TDCpp_merger(boxes, num_threads);
+    double data_merge_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    TDCpp_packed *packed_merged = new TDCpp_packed(boxes, num_threads);
+    double packed_merge_seconds = seconds_since(start);
+
+    is_same = is_same && packed_merged->get_size() == merged->get_size();
+    for (uint64_t j = 0; is_same && j < merged->get_size(); ++j) {
+        is_same = packed_merged->get_timestamp(j) == merged->get_timestamp(j) &&
+                  packed_merged->get_channel(j) == merged->get_channel(j);
+    }
+
+    printf("packed %5.1f s %7.0f Hz/channel %10" PRIu64 " events: load %7.2f -> %7.2f, merge %7.2f -> %7.2f "
+           "Mevents/s %s\n", duration, singles_rate, box_events, box_events / data_load_seconds / 1E6,
+           box_events / packed_load_seconds / 1E6, box_events / data_merge_seconds / 1E6,
+           box_events / packed_merge_seconds / 1E6, is_same ? "" : "(WRONG RESULT)");
+
+    delete merged;
+    delete packed_merged;
+    for (TDCpp_data *box : boxes) {
+        delete box;
+    }
+
+    for (const std::string &file_name : file_names) {
+        unlink(file_name.c_str());
+    }
+    rmdir(BENCHMARK_DIRECTORY);
+}
+
+/**
+ * Time the kernels on synthetic arrays: the deinterleaving of the records, the channel offsets and the drift
+ * correction.
+ */
+void benchmark_kernels() {
+    // Generate increasing timestamps on random channels, packed as in the ID800 files.
+    const uint64_t n_records = BENCHMARK_RECORDS;
+    char *records = (char *) malloc(n_records * TDCPP_RECORD_SIZE);
+    uint64_t *expected_timestamp = (uint64_t *) malloc(n_records * sizeof(uint64_t));
+    uint16_t *expected_channel = (uint16_t *) malloc(n_records * sizeof(uint16_t));
+
+    uint64_t current_timestamp = 0;
+    srand(42);
+    for (uint64_t i = 0; i < n_records; ++i) {
+        current_timestamp += (uint64_t) (rand() % 100000);
+        expected_timestamp[i] = current_timestamp;
+        expected_channel[i] = (uint16_t) (rand() % 8);
+        memcpy(records + i * TDCPP_RECORD_SIZE, &current_timestamp, TDCPP_TIMESTAMP_SIZE);
+        memcpy(records + i * TDCPP_RECORD_SIZE + TDCPP_TIMESTAMP_SIZE, expected_channel + i, TDCPP_CHANNEL_SIZE);
+    }
+
+    printf("deinterleave runtime kernel: %s\n", deinterleave_records_kernel());
+    benchmark_deinterleave("scalar", deinterleave_records_scalar, records, n_records,
+                           expected_timestamp, expected_channel);
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) {
+        benchmark_deinterleave("sse4.1", deinterleave_records_sse41, records, n_records,
+                               expected_timestamp, expected_channel);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        benchmark_deinterleave("avx2", deinterleave_records_avx2, records, n_records,
+                               expected_timestamp, expected_channel);
+    }
+
+    free(records);
+    free(expected_timestamp);
+    free(expected_channel);
+
+    // Offsets that are small and large with respect to the mean time between events (1000 bins).
+    const int16_t small_offset[8] = {0, -40, 25, 3, 0, -7, 100, 0};
+    const int16_t large_offset[8] = {0, -20000, 15000, 3000, 0, -7000, 30000, 0};
+    benchmark_channel_offset("small offsets", small_offset, 1000);
+    benchmark_channel_offset("large offsets", large_offset, 1000);
+    benchmark_channel_offset("high rate", large_offset, 100);
+
+    // A segment of 10ms, with a drift of 3 ppm.
+    benchmark_data drift_data(BENCHMARK_EVENTS, 30000);
+    const uint64_t *drift_timestamp = drift_data.get_timestamp_array();
+    const int64_t correction = drift_correction_fixed_point(1000000000, 1000003000);
+    uint64_t *expected = (uint64_t *) malloc(BENCHMARK_EVENTS * sizeof(uint64_t));
+    double_correct_drift(drift_timestamp, BENCHMARK_EVENTS, expected, drift_timestamp[0], 0, correction,
+                         TDCPP_DRIFT_NO_LIMIT);
+
+    const uint16_t num_threads = (uint16_t) std::thread::hardware_concurrency();
+    printf("drift correction runtime kernel: %s\n", correct_drift_kernel());
+    benchmark_drift("double", double_correct_drift, 1, drift_timestamp, BENCHMARK_EVENTS, correction, expected);
+    benchmark_drift("scalar", correct_drift_scalar, 1, drift_timestamp, BENCHMARK_EVENTS, correction, expected);
+    if (__builtin_cpu_supports("avx2")) {
+        benchmark_drift("avx2", correct_drift_avx2, 1, drift_timestamp, BENCHMARK_EVENTS, correction, expected);
+    }
+    benchmark_drift("double", double_correct_drift, num_threads, drift_timestamp, BENCHMARK_EVENTS, correction,
+                    expected);
+    benchmark_drift("runtime", correct_drift, num_threads, drift_timestamp, BENCHMARK_EVENTS, correction,
+                    expected);
+
+    free(expected);
+}
+
+/**
+ * Usage: benchmark [kernels|pipeline|buffers|packed|view]
+ * Without arguments, all the benchmarks are run.
+ */
+int main(int argc, char **argv) {
+    const std::string suite = argc > 1 ? argv[1] : "";
+
+    if (suite.empty() || suite == "kernels") {
+        benchmark_kernels();
+    }
+
+    if (suite.empty() || suite == "buffers") {
+        benchmark_buffers();
+    }
+
+    if (suite.empty() || suite == "packed") {
+        const int16_t small_offset[8] = {0, -40, 25, 3, 0, -7, 100, 0};
+        const int16_t large_offset[8] = {0, -20000, 15000, 3000, 0, -7000, 30000, 0};
+        benchmark_packed("small offsets", small_offset, 1000);
+        benchmark_packed("large offsets", large_offset, 100);
+        benchmark_packed_loading(2, 200000, (uint16_t) std::thread::hardware_concurrency());
+    }
+
+    if (suite.empty() || suite == "view") {
+        benchmark_view(1000);
+    }
+
+    if (suite.empty() || suite == "pipeline") {
+        // A range of sizes and rates, from a short low rate acquisition to a long high rate one.
+        const uint16_t num_threads = (uint16_t) std::thread::hardware_concurrency();
+        const double durations[] = {0.5, 2};
+        const double singles_rates[] = {20000, 200000};
+        for (double duration : durations) {
+            for (double singles_rate : singles_rates) {
+                benchmark_pipeline(duration, singles_rate, num_threads);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include <iostream>
+#include <csignal>
+#include <cstdlib>
+#include "TDCpp/TDCpp_follow.h"
+
+static void stop_following(int) {
+    TDCpp_follow::request_stop();
+}
+
+/**
+ * Follow timestamps1.txt while it is being acquired, publishing the two-fold counts every second.
+ * Usage: follow [publish interval in seconds] [idle timeout in seconds]
+ * Without an idle timeout, it runs until it is interrupted.
+ */
+int main(int argc, char **argv) {
+    double publish_interval = argc > 1 ? atof(argv[1]) : 1;
+    double idle_timeout = argc > 2 ? atof(argv[2]) : 0;
+
+    // The remaining events are counted and published before exiting.
+    signal(SIGINT, stop_following);
+    signal(SIGTERM, stop_following);
+
+    TDCpp_follow *data = new TDCpp_follow("timestamps1.txt", 8, 1);
+
+    data->set_channel_offset("offset.conf");
+    data->follow_n_fold_coincidences(2, "singles.temp", "coincidences.temp", 30, publish_interval, idle_timeout);
+
+    delete data;
+
+    FILE *done_file = fopen("done.task", "w+");
+    fprintf(done_file, "Task completed.\n");
+    fclose(done_file);
+
+    return 0;
+}
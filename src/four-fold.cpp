@@ -3,48 +3,56 @@
 #include <future>
 #include "TDCpp/TDCpp_data.h"
 #include "TDCpp/TDCpp_merger.h"
-
-//#define TIME_PROGRAM
-#ifdef TIME_PROGRAM
-    #include <ctime>
-#endif
+#include "TDCpp/TDCpp_cache.h"
+#include "TDCpp/TDCpp_metrics.h"
 
 int main() {
-#ifdef TIME_PROGRAM
-    clock_t start_clock = clock();
-#endif
+    // The merged events only depend on these files and parameters, reuse them from a previous run if possible.
+    TDCpp_cache cache;
+    cache.add_box_file("timestamps1.txt", 1);
+    cache.add_box_file("timestamps2.txt", 2);
+    cache.add_box_file("timestamps3.txt", 3);
+    cache.add_parameter("clock", 8);
+
+    TDCpp_data *all_together = new TDCpp_data();
+    if (!cache.load(all_together, (uint16_t) std::thread::hardware_concurrency())) {
+        delete all_together;
+
+        TDCpp_data *first_file = new TDCpp_data();
+        TDCpp_data *second_file = new TDCpp_data();
+        TDCpp_data *third_file = new TDCpp_data();
 
-    TDCpp_data *first_file = new TDCpp_data();
-    TDCpp_data *second_file = new TDCpp_data();
-    TDCpp_data *third_file = new TDCpp_data();
+        std::thread first_thread(&TDCpp_data::load_from_mapped_file, first_file, "timestamps1.txt", 8, 1);
+        std::thread second_thread(&TDCpp_data::load_from_mapped_file, second_file, "timestamps2.txt", 8, 2);
+        std::thread third_thread(&TDCpp_data::load_from_mapped_file, third_file, "timestamps3.txt", 8, 3);
 
-    std::thread first_thread(&TDCpp_data::load_from_file, first_file, "timestamps1.txt", 8, 1);
-    std::thread second_thread(&TDCpp_data::load_from_file, second_file, "timestamps2.txt", 8, 2);
-    std::thread third_thread(&TDCpp_data::load_from_file, third_file, "timestamps3.txt", 8, 3);
+        first_thread.join();
+        second_thread.join();
+        third_thread.join();
 
-    first_thread.join();
-    second_thread.join();
-    third_thread.join();
+        // Match the second and third boxes to the first one and merge all of them in a single pass.
+        TDCpp_merger *merger = new TDCpp_merger(std::vector<TDCpp_data *>{first_file, second_file, third_file},
+                                                (uint16_t) std::thread::hardware_concurrency());
 
-    TDCpp_merger *first_plus_second = new TDCpp_merger(first_file, second_file);
-    delete first_file;
-    delete second_file;
+        delete first_file;
+        delete second_file;
+        delete third_file;
 
-    TDCpp_merger *all_together = new TDCpp_merger(first_plus_second, third_file);
-    delete first_plus_second;
-    delete third_file;
+        all_together = merger;
+        cache.save(all_together);
+    }
 
-    all_together->find_n_fold_coincidences(4, "singles.temp", "coincidences.temp", 100, true);
+    all_together->find_n_fold_coincidences(4, "singles.temp", "coincidences.temp", 100, true,
+                                           (uint16_t) std::thread::hardware_concurrency());
 
     delete all_together;
 
+    // The wall time, throughput and memory of each stage, next to the results.
+    TDCpp_metrics::save(TDCPP_METRICS_FILE);
+
     FILE* done_file = fopen("done.task", "w+");
     fprintf(done_file, "Task completed.\n");
     fclose(done_file);
 
-#ifdef TIME_PROGRAM
-    std::cout << ((double) clock() - start_clock) / CLOCKS_PER_SEC << std::endl;
-#endif
-
     return 0;
 }
\ No newline at end of file
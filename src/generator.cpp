@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+#include "TDCpp/TDCpp_generator.h"
+
+/**
+ * Write synthetic timestamp files, timestamps1.txt, timestamps2.txt, ... in the working directory.
+ * Usage: generator [-b boxes] [-t seconds] [-r singles rate] [-c clock rate] [-n fold] [-k correlated rate]
+ *                  [-j jitter in ps] [-d drift in ppm] [-s start delay in s] [-S seed]
+ * Box i (from 0) gets a drift of i times the one given, with alternating sign, and starts i times the start delay
+ * after the first box.
+ */
+int main(int argc, char **argv) {
+    uint16_t num_boxes = 3;
+    double duration = 1;
+    double singles_rate = TDCPP_GENERATOR_SINGLES_RATE;
+    double clock_rate = TDCPP_GENERATOR_CLOCK_RATE;
+    uint16_t coincidence_n = 2;
+    double coincidence_rate = 10000;
+    double jitter = 100;
+    double drift = 2;
+    double start_delay = 0.01;
+    uint64_t seed = 1;
+
+    int option;
+    while ((option = getopt(argc, argv, "b:t:r:c:n:k:j:d:s:S:")) != -1) {
+        switch (option) {
+            case 'b': num_boxes = (uint16_t) atoi(optarg); break;
+            case 't': duration = atof(optarg); break;
+            case 'r': singles_rate = atof(optarg); break;
+            case 'c': clock_rate = atof(optarg); break;
+            case 'n': coincidence_n = (uint16_t) atoi(optarg); break;
+            case 'k': coincidence_rate = atof(optarg); break;
+            case 'j': jitter = atof(optarg); break;
+            case 'd': drift = atof(optarg); break;
+            case 's': start_delay = atof(optarg); break;
+            case 'S': seed = strtoull(optarg, nullptr, 10); break;
+            default:
+                std::cerr << "Usage: generator [-b boxes] [-t seconds] [-r singles rate] [-c clock rate] [-n fold] "
+                             "[-k correlated rate] [-j jitter in ps] [-d drift in ppm] [-s start delay in s] [-S seed]"
+                          << std::endl;
+                return EXIT_FAILURE;
+        }
+    }
+
+    TDCpp_generator generator(num_boxes, duration, seed);
+    generator.set_singles_rate(singles_rate);
+    generator.set_clock_rate(clock_rate);
+    generator.set_coincidences(coincidence_n, coincidence_rate, jitter * 1E-12);
+
+    for (uint16_t i = 0; i < num_boxes; ++i) {
+        generator.set_drift(i, (i % 2 == 0 ? 1 : -1) * i * drift * 1E-6);
+        generator.set_start_delay(i, i * start_delay);
+    }
+
+    for (uint16_t i = 0; i < num_boxes; ++i) {
+        std::string file_name = "timestamps" + std::to_string(i + 1) + ".txt";
+        uint64_t n_events = generator.write_file(i, file_name.c_str());
+        std::cout << "Wrote " << n_events << " events to " << file_name << std::endl;
+    }
+
+    return 0;
+}
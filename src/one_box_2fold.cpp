@@ -1,18 +1,22 @@
 #include <iostream>
-#include "TDCpp/TDCpp_data.h"
+#include "TDCpp/TDCpp_stream.h"
+#include "TDCpp/TDCpp_metrics.h"
 
 int main() {
-    TDCpp_data *data = new TDCpp_data();
-    data->load_from_file("timestamps1.txt", 8, 1);
+    // The file is read in chunks, so that the memory use does not depend on the length of the acquisition.
+    TDCpp_stream *data = new TDCpp_stream("timestamps1.txt", 8, 1);
 
     data->set_channel_offset("offset.conf");
     data->find_n_fold_coincidences(2, "singles.temp", "coincidences.temp", 30);
 
     delete data;
 
+    // The wall time, throughput and memory of each stage, next to the results.
+    TDCpp_metrics::save(TDCPP_METRICS_FILE);
+
     FILE *done_file = fopen("done.task", "w+");
     fprintf(done_file, "Task completed.\n");
     fclose(done_file);
 
     return 0;
-}
\ No newline at end of file
+}
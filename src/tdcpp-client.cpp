@@ -0,0 +1,74 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "TDCpp/TDCpp_daemon.h"
+
+/**
+ * Send requests to tdcpp-daemon and print its responses.
+ * Usage: tdcpp-client [request words...]
+ * Without arguments, the requests are read from the standard input, one per line.
+ * The socket is TDCPP_SOCKET from the environment, or the default one in the working directory.
+ * The exit code is 1 if any request failed.
+ */
+int main(int argc, char **argv) {
+    const char *socket_path = getenv("TDCPP_SOCKET");
+    if (socket_path == nullptr) socket_path = TDCPP_DAEMON_SOCKET;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    int descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (descriptor < 0 || connect(descriptor, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        std::cerr << "Could not connect to " << socket_path << std::endl;
+        return 2;
+    }
+
+    std::string request;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            if (i > 1) request.push_back(' ');
+            request.append(argv[i]);
+        }
+    }
+
+    int exit_code = 0;
+    std::string pending;
+    bool has_request = argc > 1 || (bool) std::getline(std::cin, request);
+
+    while (has_request) {
+        request.push_back('\n');
+        if (send(descriptor, request.data(), request.size(), 0) != (ssize_t) request.size()) {
+            std::cerr << "Could not send the request." << std::endl;
+            return 2;
+        }
+
+        // Every request gets exactly one response line.
+        size_t line_end;
+        while ((line_end = pending.find('\n')) == std::string::npos) {
+            char buffer[4096];
+            ssize_t received = recv(descriptor, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                std::cerr << "The daemon closed the connection." << std::endl;
+                return 2;
+            }
+            pending.append(buffer, (size_t) received);
+        }
+
+        std::string response = pending.substr(0, line_end);
+        pending.erase(0, line_end + 1);
+        std::cout << response << std::endl;
+
+        if (response.compare(0, 2, "OK") != 0) exit_code = 1;
+
+        has_request = argc == 1 && (bool) std::getline(std::cin, request);
+    }
+
+    close(descriptor);
+
+    return exit_code;
+}
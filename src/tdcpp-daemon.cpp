@@ -0,0 +1,40 @@
+#include <iostream>
+#include <csignal>
+#include <cstring>
+#include <thread>
+#include "TDCpp/TDCpp_daemon.h"
+
+static void stop_daemon(int) {
+    TDCpp_daemon::request_stop();
+}
+
+/**
+ * Serve analysis requests on a local socket, keeping the datasets in memory between them.
+ * Usage: tdcpp-daemon [socket path]
+ */
+int main(int argc, char **argv) {
+    // The errors of a request are sent back to the client, they must not stop the daemon.
+    set_error_exceptions(true);
+
+    // Without SA_RESTART, a signal interrupts the wait for a connection.
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = stop_daemon;
+    sigaction(SIGINT, &stop_action, nullptr);
+    sigaction(SIGTERM, &stop_action, nullptr);
+
+    TDCpp_daemon *daemon = new TDCpp_daemon(argc > 1 ? argv[1] : TDCPP_DAEMON_SOCKET,
+                                            (uint16_t) std::thread::hardware_concurrency());
+
+    int exit_code = EXIT_SUCCESS;
+    try {
+        daemon->run();
+    } catch (const TDCpp_error &) {
+        // The error has already been logged.
+        exit_code = EXIT_FAILURE;
+    }
+
+    delete daemon;
+
+    return exit_code;
+}